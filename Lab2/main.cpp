@@ -1,5 +1,6 @@
 // main.cpp —— 命令行解析，调用发送端 / 接收端
 #include "rudp.h"
+#include "rudp_cc.h"
 
 #include <iostream>
 
@@ -7,6 +8,27 @@ int    g_linkDelayMs = 0;
 double g_lossRate    = 0.0;
 int    g_recvWindow  = DEFAULT_RECV_WINDOW;
 
+std::string g_congestionControl = "reno";
+bool        g_pacingEnabled     = true;
+int         g_ioBatchSize       = DEFAULT_IO_BATCH;
+bool        g_udpOffload        = false;
+bool        g_registeredIo      = false;
+bool        g_directWrite       = false;
+bool        g_mmapInput         = false;
+bool        g_crc32c            = false;
+bool        g_sackBitmap        = false;
+int         g_ackEvery          = DEFAULT_ACK_EVERY;
+int         g_ackDelayMs        = DEFAULT_ACK_DELAY_MS;
+int         g_fecGroup          = 0;
+int         g_payloadSize       = 0;
+bool        g_pmtuProbe         = false;
+int         g_maxSessions       = DEFAULT_MAX_SESSIONS;
+int         g_recvWorkers       = 1;
+int         g_streams           = 1;
+
+DataPathCounters  g_dataPath;
+std::atomic<bool> g_stopReceiver{false};
+
 static int clampWindowSize(int value)
 {
     if (value < 1)
@@ -20,7 +42,159 @@ static void printUsage()
 {
     std::cout << "Usage:\n"
               << "  rudp.exe recv <port> <output_file> [window_size]\n"
-              << "  rudp.exe send <server_ip> <port> <input_file> [delay_ms] [loss_percent]\n";
+              << "  rudp.exe serve <port> <output_dir> [window_size]\n"
+              << "  rudp.exe send <server_ip> <port> <input_file> [delay_ms] [loss_percent] [options]\n"
+              << "  rudp.exe selftest                 check every checksum kernel against the reference\n"
+              << "  rudp.exe bench [checksum|loopback [MB]|all]\n"
+              << "                                    built-in benchmarks (default all; loopback\n"
+              << "                                    sends MB of data to itself, plain and --rio)\n"
+              << "Options:\n"
+              << "  --cc=reno|cubic|bbr     congestion control algorithm (send, default reno)\n"
+              << "  --no-pacing             send each window back-to-back (send)\n"
+              << "  --batch=N               max packets per batched send/receive (default "
+              << DEFAULT_IO_BATCH << ")\n"
+              << "  --offload               use UDP segmentation / receive coalescing offload if available\n"
+              << "  --rio                   use Registered I/O for the data path if available\n"
+              << "  --direct-write          write each packet at its file offset, no reorder buffering (recv)\n"
+              << "  --mmap                  memory-map the input file and send straight from it (send)\n"
+              << "  --crc32c                request CRC32C instead of the 16-bit checksum (send)\n"
+              << "  --sack-bitmap           request bitmap SACK and retransmit every reported hole (send)\n"
+              << "  --ack-every=N           ACK every N in-order packets (recv, default "
+              << DEFAULT_ACK_EVERY << ", 1 = ACK each packet)\n"
+              << "  --ack-delay=MS          max delay of a pending ACK (recv, default "
+              << DEFAULT_ACK_DELAY_MS << ")\n"
+              << "  --fec=N                 send one XOR parity packet per N data packets (send, 2.."
+              << MAX_FEC_GROUP << ")\n"
+              << "  --payload=N             requested (send) / max accepted (recv) payload bytes, up to "
+              << MAX_NEGOTIATED_PAYLOAD << "\n"
+              << "  --pmtu-probe            probe the largest deliverable payload after the handshake (send)\n"
+              << "  --max-sessions=N        max concurrent sessions (serve, default "
+              << DEFAULT_MAX_SESSIONS << ")\n"
+              << "  --streams=N             split the file into N ranges sent over parallel connections (send, up to "
+              << MAX_STREAMS << ")\n"
+              << "  --workers=N             worker threads sharing the sessions (serve, default 1, up to "
+              << MAX_RECV_WORKERS << ")\n";
+}
+
+// 解析一个 --name=value 形式的可选项，无法识别时返回 false
+static bool applyOption(const std::string& opt)
+{
+    size_t eq = opt.find('=');
+    std::string name  = opt.substr(0, eq);
+    std::string value = (eq == std::string::npos) ? "" : opt.substr(eq + 1);
+
+    if (name == "--cc")
+    {
+        if (!makeCongestionController(value))
+            return false;
+        g_congestionControl = value;
+        return true;
+    }
+    if (name == "--no-pacing" && eq == std::string::npos)
+    {
+        g_pacingEnabled = false;
+        return true;
+    }
+    if (name == "--batch" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 1 || n > 1024)
+            return false;
+        g_ioBatchSize = n;
+        return true;
+    }
+    if (name == "--ack-every" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 1 || n > 1024)
+            return false;
+        g_ackEvery = n;
+        return true;
+    }
+    if (name == "--ack-delay" && !value.empty())
+    {
+        int ms = std::stoi(value);
+        if (ms < 0 || ms > 500)
+            return false;
+        g_ackDelayMs = ms;
+        return true;
+    }
+    if (name == "--fec" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 2 || n > MAX_FEC_GROUP)
+            return false;
+        g_fecGroup = n;
+        return true;
+    }
+    if (name == "--payload" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 64 || n > MAX_NEGOTIATED_PAYLOAD)
+            return false;
+        g_payloadSize = n;
+        return true;
+    }
+    if (name == "--pmtu-probe" && eq == std::string::npos)
+    {
+        g_pmtuProbe = true;
+        return true;
+    }
+    if (name == "--max-sessions" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 1 || n > 65535)
+            return false;
+        g_maxSessions = n;
+        return true;
+    }
+    if (name == "--streams" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 1 || n > MAX_STREAMS)
+            return false;
+        g_streams = n;
+        return true;
+    }
+    if (name == "--workers" && !value.empty())
+    {
+        int n = std::stoi(value);
+        if (n < 1 || n > MAX_RECV_WORKERS)
+            return false;
+        g_recvWorkers = n;
+        return true;
+    }
+    if (name == "--offload" && eq == std::string::npos)
+    {
+        g_udpOffload = true;
+        return true;
+    }
+    if (name == "--rio" && eq == std::string::npos)
+    {
+        g_registeredIo = true;
+        return true;
+    }
+    if (name == "--direct-write" && eq == std::string::npos)
+    {
+        g_directWrite = true;
+        return true;
+    }
+    if (name == "--mmap" && eq == std::string::npos)
+    {
+        g_mmapInput = true;
+        return true;
+    }
+    if (name == "--crc32c" && eq == std::string::npos)
+    {
+        g_crc32c = true;
+        return true;
+    }
+    if (name == "--sack-bitmap" && eq == std::string::npos)
+    {
+        g_sackBitmap = true;
+        return true;
+    }
+    return false;
 }
 
 int main(int argc, char* argv[])
@@ -41,19 +215,52 @@ int main(int argc, char* argv[])
 
     std::string mode = argv[1];
 
-    if (mode == "recv")
+    // 位置参数与 -- 开头的可选项分开，可选项可以出现在任意位置
+    std::vector<std::string> args;
+    bool optionsOk = true;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0)
+        {
+            if (!applyOption(arg))
+            {
+                std::cerr << "unknown or invalid option: " << arg << "\n";
+                optionsOk = false;
+            }
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    int exitCode = 0;
+    if (!optionsOk)
+    {
+        printUsage();
+    }
+    else if (mode == "selftest")
+    {
+        exitCode = runSelfTest();
+    }
+    else if (mode == "bench")
+    {
+        exitCode = runBenchmark(args);
+    }
+    else if (mode == "recv")
     {
-        if (argc != 4 && argc != 5)
+        if (args.size() != 2 && args.size() != 3)
         {
             printUsage();
         }
         else
         {
-            uint16_t port = static_cast<uint16_t>(std::stoi(argv[2]));
-            std::string outFile = argv[3];
-            if (argc == 5)
+            uint16_t port = static_cast<uint16_t>(std::stoi(args[0]));
+            std::string outFile = args[1];
+            if (args.size() == 3)
             {
-                g_recvWindow = clampWindowSize(std::stoi(argv[4]));
+                g_recvWindow = clampWindowSize(std::stoi(args[2]));
             }
             else
             {
@@ -62,29 +269,44 @@ int main(int argc, char* argv[])
             runReceiver(port, outFile);
         }
     }
+    else if (mode == "serve")
+    {
+        if (args.size() != 2 && args.size() != 3)
+        {
+            printUsage();
+        }
+        else
+        {
+            uint16_t port = static_cast<uint16_t>(std::stoi(args[0]));
+            if (args.size() == 3)
+                g_recvWindow = clampWindowSize(std::stoi(args[2]));
+            runServer(port, args[1]);
+        }
+    }
     else if (mode == "send")
     {
-        if (argc != 5 && argc != 7)
+        if (args.size() != 3 && args.size() != 5)
         {
             printUsage();
         }
         else
         {
-            std::string ip   = argv[2];
-            uint16_t    port = static_cast<uint16_t>(std::stoi(argv[3]));
-            std::string file = argv[4];
+            std::string ip   = args[0];
+            uint16_t    port = static_cast<uint16_t>(std::stoi(args[1]));
+            std::string file = args[2];
 
             int    delayMs  = 0;
             double lossRate = 0.0;
 
-            if (argc == 7)
+            if (args.size() == 5)
             {
-                delayMs  = std::stoi(argv[5]);
-                lossRate = std::stod(argv[6]) / 100.0;
+                delayMs  = std::stoi(args[3]);
+                lossRate = std::stod(args[4]) / 100.0;
             }
 
             setLinkOptions(delayMs, lossRate);
-            runSender(ip, port, file);
+            if (!runSender(ip, port, file))
+                exitCode = 1;
         }
     }
     else
@@ -93,5 +315,5 @@ int main(int argc, char* argv[])
     }
 
     WSACleanup();
-    return 0;
+    return exitCode;
 }
@@ -4,30 +4,96 @@
 
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <mswsock.h>
 #pragma comment(lib, "ws2_32.lib")
 #define NOMINMAX
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <vector>
 #include <string>
 //======== 协议参数 =======================
 
-inline constexpr int MAX_PAYLOAD            = 1000;   // 每个数据分组最大负载
+inline constexpr int MAX_PAYLOAD            = 1000;   // 默认的数据分组负载（握手没有协商负载大小时使用）
 inline constexpr int DEFAULT_RECV_WINDOW   = 64;     // 默认接收窗口大小（流量控制）
 inline constexpr int TIMEOUT_MS            = 100;    // 数据分组超时时间
+inline constexpr int RTO_MIN_MS            = 20;     // 自适应 RTO 下限
+inline constexpr int RTO_MAX_MS            = 5000;   // 自适应 RTO 上限（含指数退避）
 inline constexpr int HANDSHAKE_TIMEOUT_MS  = 1000;   // 握手 / 挥手阶段超时时间
 inline constexpr int MAX_SACK_BLOCKS       = 4;      // 一次 ACK 携带的最大区间数
+inline constexpr int MAX_SACK_BITMAP_BITS  = 4096;   // 位图 SACK 最多描述累计确认点之后的分组数
+inline constexpr int SACK_DUP_THRESH       = 3;      // 位图 SACK：某分组之后已有这么多分组到达即判定它丢失
+inline constexpr int DEFAULT_IO_BATCH      = 32;     // 默认每批收发的最大分组数
+inline constexpr int DEFAULT_ACK_EVERY     = 2;      // 接收端默认每收到几个按序分组回一个 ACK
+inline constexpr int DEFAULT_ACK_DELAY_MS  = 1;      // 接收端延迟 ACK 的最长等待时间
+inline constexpr int MAX_FEC_GROUP         = 64;     // 前向纠错每组最多的 DATA 分组数
+inline constexpr int PMTU_PROBE_TIMEOUT_MS = 200;    // 路径 MTU 探测：单个探测分组的等待时间
+inline constexpr int PMTU_MAX_PROBES       = 3;      // 同一大小连续探测失败几次才认为过大
+inline constexpr int PMTU_SEARCH_STEP      = 64;     // 探测上下界相差不到这么多就停止搜索
+inline constexpr int PMTU_COMMIT_TRIES     = 5;      // 通知接收端最终负载大小的最多尝试次数
+inline constexpr int MAX_SOCKET_BUFFER     = 64 << 20;   // 按负载放大套接字缓冲区的上限
+inline constexpr int DEFAULT_MAX_SESSIONS  = 256;    // serve 模式默认同时服务的最大会话数
+inline constexpr int SESSION_IDLE_TIMEOUT_MS = 30000;   // 接收会话多久收不到对端分组就放弃
+inline constexpr int MAX_RECV_WORKERS      = 64;     // serve 模式最多的工作线程数
+inline constexpr int MAX_STREAMS           = 64;     // 一个文件最多拆成的并行流数
+inline constexpr size_t WORKER_RING_BYTES  = 8u << 20;   // 分发线程交给每个工作线程的数据报环大小
+inline constexpr int MAX_OFFLOAD_BYTES     = 65507;  // 分段卸载超级缓冲区上限（IPv4 最大 UDP 负载）
+inline constexpr int MAX_OFFLOAD_SEGMENTS  = 64;     // 一个超级缓冲区最多包含的分段数
 
-extern int g_dataTimeoutMs;  // 运行时使用的“数据超时”
+// 较老的 SDK 里没有这两个 UDP 选项
+#ifndef UDP_SEND_MSG_SIZE
+#define UDP_SEND_MSG_SIZE 2
+#endif
+#ifndef UDP_RECV_MAX_COALESCED_SIZE
+#define UDP_RECV_MAX_COALESCED_SIZE 3
+#endif
+
+extern int g_dataTimeoutMs;  // 运行时使用的“数据超时”（发送端的初始 RTO）
 extern int g_recvWindow;     // 运行时接收窗口大小
+extern std::string g_congestionControl;  // 发送端拥塞控制算法名（reno / cubic / bbr）
+extern bool g_pacingEnabled;             // 发送端是否对新 DATA 分组做 pacing
+extern int  g_ioBatchSize;               // 每批收发的最大分组数
+extern bool g_udpOffload;                // 是否尝试 UDP 分段卸载（USO / URO）
+extern bool g_registeredIo;              // 数据通路是否尝试 Registered I/O（RIO）
+extern bool g_directWrite;               // 接收端是否按分组偏移直接写文件（定位写）
+extern bool g_mmapInput;                 // 发送端是否把输入文件内存映射后直接引用
+extern bool g_crc32c;                    // 发送端是否在握手中请求 CRC32C 校验
+extern bool g_sackBitmap;                // 发送端是否在握手中请求位图 SACK
+extern int  g_ackEvery;                  // 接收端每累计几个按序分组回一个 ACK（1 表示逐个确认）
+extern int  g_ackDelayMs;                // 接收端延迟 ACK 的最长等待时间（毫秒）
+extern int  g_fecGroup;                  // 发送端前向纠错分组大小（0 表示关闭）
+extern int  g_payloadSize;               // 发送端请求 / 接收端接受的最大负载（0 表示默认）
+extern bool g_pmtuProbe;                 // 发送端是否在握手后探测路径 MTU
+extern int  g_maxSessions;               // serve 模式同时服务的最大会话数
+extern int  g_recvWorkers;               // serve 模式处理分组的工作线程数（1 表示单线程）
+extern int  g_streams;                   // 发送端把文件拆成几个并行流（1 表示单连接）
 // 标志位
 enum PacketFlags : uint8_t
 {
     FLAG_SYN  = 0x01,
     FLAG_ACK  = 0x02,
     FLAG_FIN  = 0x04,
-    FLAG_DATA = 0x08
+    FLAG_DATA = 0x08,
+    FLAG_CRC32C = 0x10,  // 头部后跟 4 字节 CRC32C（握手协商后使用），此时 checksum 字段为 0
+    FLAG_SACK_BITMAP = 0x20,  // ACK 负载是位图 SACK 而不是 SACK 区间（握手协商后使用）
+    FLAG_FEC  = 0x40,    // 前向纠错校验分组：负载是一组 DATA 负载的异或
+    FLAG_PROBE = 0x80    // 路径 MTU 探测分组（负载全 0）；带 FLAG_ACK 时是对探测分组 ack 的确认
+};
+
+// 握手选项：SYN 的 reserved 字节携带发送端请求的选项，SYN-ACK 原样带回接收端同意的部分
+enum HandshakeOptions : uint8_t
+{
+    OPT_CRC32C = 0x01,       // 用 CRC32C 代替 16 位校验和
+    OPT_SACK_BITMAP = 0x02,  // ACK 用位图描述累计确认点之后的接收情况
+    OPT_PAYLOAD_SIZE = 0x04, // SYN 负载是 uint16_t 请求负载大小，SYN-ACK 负载是接收端同意的大小
+    OPT_STREAM = 0x08        // 多流传输：SYN 负载（在请求负载大小之后）带 StreamDescriptor
 };
 
+// 路径 MTU 探测结束、最终负载小于协商值时，发送端在第一个 DATA 之前发一个
+// reserved = PROBE_COMMIT 的 FLAG_PROBE 分组，负载是 uint16_t 最终负载大小；
+// 接收端改用它计算定位写偏移，回 FLAG_ACK | FLAG_PROBE 确认，负载是它实际生效的大小
+inline constexpr uint8_t PROBE_COMMIT = 1;
+
 // 分组头部（16 字节）
 #pragma pack(push, 1)
 struct PacketHeader
@@ -40,8 +106,50 @@ struct PacketHeader
     uint8_t  flags;     // 标志位
     uint8_t  reserved;  // 对齐用，置 0，保留位
 };
+
+// 多流传输的流描述：一个文件拆成 count 个字节范围，每个范围由一个独立连接发送，
+// 接收端把同一发送端同一 transferId 的各个流写进同一个按 fileSize 预分配的输出文件，
+// 流内第 seq 个分组写在 offset + (seq - 1) * 协商负载 处
+struct StreamDescriptor
+{
+    uint32_t transferId;   // 同一文件的各个流相同
+    uint16_t index;        // 本流序号 [0, count)
+    uint16_t count;        // 流的总数
+    uint64_t offset;       // 本流负责的字节范围起点
+    uint64_t length;       // 本流负责的字节数
+    uint64_t fileSize;     // 整个文件的长度
+};
+
+// 扩展头部：FLAG_CRC32C 分组在基本头部后追加 CRC32C（覆盖基本头部 + 负载）
+struct ExtPacketHeader
+{
+    PacketHeader base;
+    uint32_t     crc;
+};
 #pragma pack(pop)
 
+// 连接号：发送端为每个连接随机选一个，放在 SYN 的 seq 中，之后它发出的分组都带上：
+// DATA / FEC / PROBE / FIN 放在用不到的 ack 字段，纯 ACK（握手、挥手的最后一个 ACK）放在 seq 字段。
+// 接收端按 (对端地址, 连接号) 把分组分给各自的会话
+inline uint32_t connectionIdOf(const PacketHeader& hdr)
+{
+    if (hdr.flags & FLAG_SYN)
+        return hdr.seq;
+    if (hdr.flags & (FLAG_DATA | FLAG_FEC | FLAG_PROBE | FLAG_FIN))
+        return hdr.ack;
+    return hdr.seq;
+}
+
+// 线上头部长度 / 最大分组长度
+inline size_t headerBytes(uint8_t flags)
+{
+    return (flags & FLAG_CRC32C) ? sizeof(ExtPacketHeader) : sizeof(PacketHeader);
+}
+inline constexpr size_t MAX_PACKET_BYTES = sizeof(ExtPacketHeader) + MAX_PAYLOAD;
+// 协商负载的上限：带扩展头部的分组恰好是一个最大的 UDP 数据报
+inline constexpr int MAX_NEGOTIATED_PAYLOAD =
+    MAX_OFFLOAD_BYTES - static_cast<int>(sizeof(ExtPacketHeader));
+
 // SACK 区间 [start, end]（包含端点）
 struct SackBlock
 {
@@ -49,15 +157,49 @@ struct SackBlock
     uint32_t end;
 };
 
+// 前向纠错（--fec=N）：序号 [kN+1, (k+1)N] 的 DATA 分组为第 k 组，DATA 头部 reserved 字段为 N；
+// 一组首次发送完后跟一个 FLAG_FEC 校验分组：
+//   seq = 组内第一个序号，reserved = 组内实际分组数（最后一组可能不满），
+//   wnd = 组内各负载长度的异或，负载 = 各负载补零到最长后逐字节异或
+// 组内恰好丢一个分组时，接收端用校验分组和其余分组把它还原出来
+
+// 位图 SACK 负载：[uint16_t bitCount][(bitCount + 7) / 8 字节位图]
+// 第 i 位（字节 i / 8 的第 i % 8 位）表示序号 ack + 1 + i 是否已收到，
+// bitCount 截到最后一个已收到的分组，不超过 MAX_SACK_BITMAP_BITS
+inline constexpr size_t MAX_SACK_BITMAP_BYTES = MAX_SACK_BITMAP_BITS / 8;
+
 // ======================= 公共工具函数 =======================
 
 void setRecvTimeout(SOCKET s, int ms);
+void setNonBlocking(SOCKET s, bool on);
 void printLastError(const char* where);
+// 把 SO_RCVBUF / SO_SNDBUF 至少放大到 bytes（不超过 MAX_SOCKET_BUFFER，只增不减），返回生效后的大小
+int  growSocketBuffer(SOCKET s, int optName, size_t bytes);
+// 设置 IP 头部 DF 位（路径 MTU 探测），系统不支持时返回 false
+bool setDontFragment(SOCKET s, bool on);
 
-// 16 位互联网校验和
+// 16 位互联网校验和（运行时按 CPU 选择 AVX2 / SSE2 / 64 位标量实现，结果逐位一致）
 uint16_t checksum16(const char* data, size_t len);
+const char* checksumKernelName();   // 当前使用的实现，用于统计输出
+
+// 自检 / 基准测试用：本机能运行的每个内核，以及逐字回卷的原实现（结果的基准）
+struct ChecksumKernel
+{
+    const char* name;
+    uint16_t  (*fn)(const char* data, size_t len);
+};
+std::vector<ChecksumKernel> checksumKernels();
+uint16_t checksum16Reference(const char* data, size_t len);
+
+// CRC32C（SSE4.2 crc32 指令，不支持时查表），可以分段接着算：crc 初值传 0
+uint32_t crc32c(uint32_t crc, const char* data, size_t len);
+const char* crc32cKernelName();
+
+// dst[i] ^= src[i]（前向纠错的校验分组编码 / 还原）
+void xorBytes(char* dst, const char* src, size_t len);
 
 // 发送一个分组（负责填充 hdr.len / hdr.checksum）
+// 头部与负载分两段交给 WSASendTo，负载原地计算校验和，不拷贝
 bool sendPacket(
     SOCKET s,
     const sockaddr_in& addr,
@@ -72,10 +214,176 @@ bool recvPacket(
     std::vector<char>& payload,
     sockaddr_in& from);
 
+// ======================= 批量收发 =======================
+// WinSock 没有 sendmmsg/recvmmsg，批量接口把一批分组集中提交 / 集中取出，
+// 发送端按突发攒批，接收端每次唤醒把已到达的数据报一次取完
+
+struct OutPacket
+{
+    PacketHeader hdr{};
+    const char*  payload    = nullptr;
+    uint16_t     payloadLen = 0;
+};
+
+// ======================= 分组缓冲池 =======================
+// 启动时一次性分配一组定长缓冲块（按缓存行对齐），收发路径上只在空闲链表里取 / 还，
+// 不再为每个分组 new 一个 vector
+
+inline constexpr size_t CACHE_LINE = 64;
+
+class PacketPool
+{
+public:
+    PacketPool(size_t slabSize, size_t slabCount);
+    ~PacketPool();
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    char*  acquire();              // 没有空闲块时返回 nullptr
+    void   release(char* slab);
+    size_t slabSize() const { return slabSize_; }
+    size_t slabCount() const { return slabCount_; }
+
+private:
+    size_t             slabSize_;
+    size_t             slabCount_;
+    char*              base_;
+    std::vector<char*> freeList_;
+};
+
+// payload 直接指向 RecvBatch 缓冲块中的数据报，下一次 recvPacketBatch 之前有效
+struct RecvItem
+{
+    PacketHeader hdr{};
+    const char*  payload    = nullptr;
+    uint16_t     payloadLen = 0;
+    sockaddr_in  from{};
+};
+
+// 一批接收结果：数据报收在自带缓冲池的块里，下一次 recvPacketBatch 开始时整批归还
+struct RecvBatch
+{
+    // slabBytes：每块能放下的最大数据报（协商后的分组长度，开启 URO 时为最大合并长度）
+    RecvBatch(size_t maxDatagrams, size_t slabBytes);
+
+    PacketPool            pool;
+    std::vector<char*>    held;    // 本批占用的缓冲块
+    std::vector<RecvItem> items;
+};
+
+// 发送一批分组到同一个地址（整批只模拟一次链路延迟）
+//   segmentSize：已通过 enableSendOffload 开启分段卸载时传分段大小，
+//                连续的等长分组会拼成超级缓冲区一次发出；0 表示逐个发送
+//   sendCalls：非空时累加本批实际调用 sendto 的次数
+bool sendPacketBatch(
+    SOCKET s,
+    const sockaddr_in& addr,
+    const OutPacket* pkts,
+    size_t count,
+    uint16_t segmentSize = 0,
+    size_t* sendCalls = nullptr);
+
+// 从非阻塞套接字上调用最多 maxCount 次 recvfrom（不超过缓冲池块数），
+// 结果放在 batch.items 中，返回取到的分组数
+// （开启接收合并时一个数据报可能拆出多个分组，返回值可能超过 maxCount）
+size_t recvPacketBatch(
+    SOCKET s,
+    RecvBatch& batch,
+    size_t maxCount);
+
+// 校验并拆分一个已经收到的数据报（开启接收合并时可能含多个分组），通过的分组追加到 items，
+// payload 指向 data 内部；返回追加的分组数。多线程接收端由工作线程在自己的线程里调用
+size_t parseDatagram(
+    const char* data,
+    size_t len,
+    const sockaddr_in& from,
+    std::vector<RecvItem>& items);
+
+// 一批分组中的一个经过模拟链路：返回 false 表示按丢包率丢弃；
+// 整批只在第一个未丢弃的非纯 ACK 分组处延迟一次（delayed 记录本批是否已经延迟）
+bool emulateLinkInBatch(const PacketHeader& hdr, bool& delayed);
+
+// 把分组（线上头部 + 负载）封装到 out 中连续存放，返回总字节数；
+// out 至少要有 sizeof(ExtPacketHeader) + payloadLen 字节
+size_t sealPacket(char* out, PacketHeader hdr, const char* payload, uint16_t payloadLen);
+
+// ======================= UDP 分段卸载 =======================
+// 内核 / 网卡不支持时 setsockopt 失败，返回 false，调用方回退到普通收发
+
+bool enableSendOffload(SOCKET s, uint16_t segmentSize);
+bool enableRecvOffload(SOCKET s, bool on);
+
+// ======================= 事件等待 =======================
+// 套接字的 FD_READ 事件（WSAEventSelect）和一个高精度可等待定时器一起交给
+// WaitForMultipleObjects：线程一直睡到下一个数据报到达或下一个截止时刻，
+// 不再按毫秒向上取整、也不受 select 超时的系统时钟粒度（默认约 15.6ms）影响。
+// 关联事件后套接字即为非阻塞模式，析构时解除关联（套接字仍为非阻塞）。
+// 也可以等一个现成的事件（RIO 完成队列的通知事件），这时不关联套接字
+
+class SocketWaiter
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    explicit SocketWaiter(SOCKET s);
+    explicit SocketWaiter(HANDLE readyEvent);
+    ~SocketWaiter();
+    SocketWaiter(const SocketWaiter&) = delete;
+    SocketWaiter& operator=(const SocketWaiter&) = delete;
+
+    // 等到套接字可读或 deadline 到期，返回是否可读；deadline 为 TimePoint::max() 时一直等，
+    // 已经到期时只检查一次不睡眠
+    bool wait(TimePoint deadline);
+
+    uint64_t wakeups() const { return wakeups_; }             // 从睡眠中醒来的次数
+    uint64_t timerWakeups() const { return timerWakeups_; }   // 其中因截止时刻到期醒来的次数
+    bool     highResolution() const { return highRes_; }      // 系统是否提供高精度定时器
+
+private:
+    SOCKET   s_         = INVALID_SOCKET;   // 为 INVALID_SOCKET 时等的是外部事件
+    WSAEVENT readEvent_ = WSA_INVALID_EVENT;
+    HANDLE   timer_     = nullptr;
+    bool     highRes_   = false;
+    uint64_t wakeups_      = 0;
+    uint64_t timerWakeups_ = 0;
+};
+
 // ======================= 发送端 / 接收端接口 =======================
 
-void runSender(const std::string& ip, uint16_t port, const std::string& inputFile);
+// 两端数据通路的累计计数：每个发送连接、每个监听循环结束时累加进来，内置基准测试据此汇总
+struct DataPathCounters
+{
+    std::atomic<uint64_t> txBatches{0}, txPackets{0};                  // 发送端批量发送
+    std::atomic<uint64_t> rioSends{0}, rioCommits{0}, rioSendWaits{0};  // 发送端 RIO
+    std::atomic<uint64_t> rxBatches{0}, rxPackets{0};                  // 接收端监听循环
+    std::atomic<uint64_t> rioRecvs{0}, rioDequeues{0};                 // 接收端 RIO
+    std::atomic<bool>     rioSender{false}, rioReceiver{false};        // 两端是否真的用上了 RIO
+
+    void reset()
+    {
+        for (std::atomic<uint64_t>* c : {&txBatches, &txPackets, &rioSends, &rioCommits,
+                                         &rioSendWaits, &rxBatches, &rxPackets, &rioRecvs,
+                                         &rioDequeues})
+            c->store(0);
+        rioSender   = false;
+        rioReceiver = false;
+    }
+};
+extern DataPathCounters g_dataPath;
+
+// 返回是否成功：所有数据都被确认、挥手完成且接收端回送的摘要一致（多流时每个流都要满足）
+bool runSender(const std::string& ip, uint16_t port, const std::string& inputFile);
 void runReceiver(uint16_t port, const std::string& outputFile);
+// 置位后 recv 模式的监听循环在 RECV_STOP_POLL_MS 之内退出（基准测试的发送端失败时用，
+// 否则还没等到 SYN 的接收端会一直等下去）；runReceiver 开始时不会清除它
+extern std::atomic<bool> g_stopReceiver;
+// 多会话接收端：一个端口同时接收多个发送端，每个会话写到 outputDir 下自己的文件
+void runServer(uint16_t port, const std::string& outputDir);
+
+// 内置自检与基准测试（rudp_bench.cpp）。仓库没有测试框架，由 main 的 selftest / bench 模式调用；
+// 返回进程退出码，0 表示全部通过
+int runSelfTest();
+int runBenchmark(const std::vector<std::string>& args);   // args[0] 为基准名，可以为空
 
 
 //设置丢包率和延迟时间
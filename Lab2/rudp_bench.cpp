@@ -0,0 +1,313 @@
+// rudp_bench.cpp —— 内置自检与基准测试：rudp.exe selftest / rudp.exe bench
+#include "rudp.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <streambuf>
+#include <thread>
+
+// ======================= 校验和自检 =======================
+// 每个可选内核都和逐字回卷的原实现逐位比较：随机内容、全 0、全 0xFF，
+// 奇数长度、任意起始偏移（不对齐），以及跨过 SIMD 内核中间倒出累加器的长度
+
+static constexpr uint64_t SELFTEST_SEED      = 0x52554450;   // 固定种子，失败可以复现
+static constexpr int      SELFTEST_CASES     = 20000;        // 随机用例数
+// 全 0xFF 时 32 位通道约 32768 轮溢出（AVX2 约 1MB），最长用例要超过它才能发现倒出间隔算错
+static constexpr size_t   SELFTEST_MAX_LEN   = 1100000;
+static constexpr size_t   SELFTEST_MAX_SHIFT = 64;           // 起始偏移 0..63
+
+// 用 pattern 填满缓冲区：0 随机，1 全 0，2 全 0xFF
+static void fillPattern(std::vector<char>& buf, int pattern, std::mt19937_64& rng)
+{
+    if (pattern == 1)
+        std::memset(buf.data(), 0, buf.size());
+    else if (pattern == 2)
+        std::memset(buf.data(), 0xFF, buf.size());
+    else
+        for (char& c : buf)
+            c = static_cast<char>(rng());
+}
+
+// 比较所有内核在 [shift, shift+len) 上的结果，不一致时打印第一处并返回 false
+static bool checkAllKernels(const std::vector<ChecksumKernel>& kernels,
+                            const std::vector<char>& buf, size_t shift, size_t len,
+                            int pattern)
+{
+    const char* data = buf.data() + shift;
+    const uint16_t expect = checksum16Reference(data, len);
+    bool ok = true;
+    for (const ChecksumKernel& k : kernels)
+    {
+        uint16_t got = k.fn(data, len);
+        if (got != expect)
+        {
+            std::cout << "  MISMATCH kernel=" << k.name << " len=" << len
+                      << " shift=" << shift << " pattern=" << pattern << std::hex
+                      << " expect=0x" << expect << " got=0x" << got << std::dec << "\n";
+            ok = false;
+        }
+    }
+    // 分派后的 checksum16 也要一致
+    if (checksum16(data, len) != expect)
+    {
+        std::cout << "  MISMATCH checksum16 len=" << len << " shift=" << shift << "\n";
+        ok = false;
+    }
+    return ok;
+}
+
+static bool selfTestChecksum()
+{
+    const std::vector<ChecksumKernel> kernels = checksumKernels();
+    std::cout << "[selftest] checksum16 kernels:";
+    for (const ChecksumKernel& k : kernels)
+        std::cout << " " << k.name;
+    std::cout << " (dispatch=" << checksumKernelName() << ", seed=" << SELFTEST_SEED << ")\n";
+
+    std::mt19937_64 rng(SELFTEST_SEED);
+    std::vector<char> buf(SELFTEST_MAX_LEN + SELFTEST_MAX_SHIFT);
+    uint64_t cases = 0, failures = 0;
+
+    for (int pattern = 0; pattern < 3; ++pattern)
+    {
+        fillPattern(buf, pattern, rng);
+        // 短长度逐个覆盖，每个长度配上所有起始偏移
+        for (size_t len = 0; len <= 256; ++len)
+            for (size_t shift = 0; shift < SELFTEST_MAX_SHIFT; ++shift, ++cases)
+                failures += !checkAllKernels(kernels, buf, shift, len, pattern);
+        // 长缓冲区：内核倒出累加器的边界前后，以及最长的情况
+        for (size_t len : {size_t(131071), size_t(131072), size_t(131073), size_t(65536 + 3),
+                           SELFTEST_MAX_LEN - 1, SELFTEST_MAX_LEN})
+            for (size_t shift : {size_t(0), size_t(1), SELFTEST_MAX_SHIFT - 1})
+            {
+                ++cases;
+                failures += !checkAllKernels(kernels, buf, shift, len, pattern);
+            }
+    }
+
+    // 随机内容、随机长度、随机偏移，其中一部分把全 0xFF 的片段混进随机数据
+    fillPattern(buf, 0, rng);
+    std::uniform_int_distribution<size_t> lenDist(0, 70000);
+    std::uniform_int_distribution<size_t> shiftDist(0, SELFTEST_MAX_SHIFT - 1);
+    for (int i = 0; i < SELFTEST_CASES; ++i, ++cases)
+    {
+        size_t len   = lenDist(rng);
+        size_t shift = shiftDist(rng);
+        if (i % 8 == 0)
+            std::memset(buf.data() + shift, 0xFF, std::min<size_t>(len, 512));
+        failures += !checkAllKernels(kernels, buf, shift, len, 0);
+        if (failures > 16)
+            break;
+    }
+
+    std::cout << "[selftest] checksum16: " << cases << " cases, " << failures << " failures\n";
+    return failures == 0;
+}
+
+
+int runSelfTest()
+{
+    bool ok = selfTestChecksum();
+    std::cout << "[selftest] " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok ? 0 : 1;
+}
+
+
+// ======================= 校验和吞吐 =======================
+// 每个内核（以及原实现）对几种典型分组长度各跑约 BENCH_CHECKSUM_MS 毫秒
+
+static constexpr int BENCH_CHECKSUM_MS = 200;
+
+template <typename Fn>
+static double measureGBps(Fn fn, const char* data, size_t len)
+{
+    using BenchClock = std::chrono::steady_clock;
+    volatile uint16_t sink = 0;
+    uint64_t bytes = 0;
+    const auto start = BenchClock::now();
+    auto now = start;
+    do
+    {
+        for (int r = 0; r < 64; ++r)
+            sink = sink ^ fn(data, len);
+        bytes += 64ull * len;
+        now = BenchClock::now();
+    } while (now - start < std::chrono::milliseconds(BENCH_CHECKSUM_MS));
+    double sec = std::chrono::duration<double>(now - start).count();
+    return bytes / sec / 1e9;
+}
+
+static void benchChecksum()
+{
+    // 最小分组、默认 1000 字节负载的分组、巨帧、最大负载
+    const size_t lens[] = {64, sizeof(PacketHeader) + MAX_PAYLOAD, 9000,
+                           static_cast<size_t>(MAX_OFFLOAD_BYTES)};
+    std::vector<char> buf(MAX_OFFLOAD_BYTES + 1);
+    std::mt19937_64 rng(SELFTEST_SEED);
+    for (char& c : buf)
+        c = static_cast<char>(rng());
+    const char* data = buf.data() + 1;   // 故意不对齐
+
+    std::cout << "===== checksum16 throughput (GB/s, unaligned) =====\n";
+    std::cout << "kernel     ";
+    for (size_t len : lens)
+        std::cout << "  len=" << len;
+    std::cout << "\n";
+
+    auto row = [&](const char* name, uint16_t (*fn)(const char*, size_t))
+    {
+        std::cout << name << std::string(11 - std::strlen(name), ' ');
+        for (size_t len : lens)
+            std::cout << "  " << measureGBps(fn, data, len);
+        std::cout << "\n";
+    };
+    row("reference", checksum16Reference);
+    for (const ChecksumKernel& k : checksumKernels())
+        row(k.name, k.fn);
+}
+
+
+// ======================= 回环传输 =======================
+// 同一进程里在 127.0.0.1 上起一个 recv 接收端线程，再用 send 把测试文件发给它，
+// 普通收发和 --rio 各跑一次，输出吞吐、批量统计和 RIO 计数。
+// 其他可选项（--batch、--payload、--streams、--offload 等）照常生效，两次运行相同
+
+static constexpr uint16_t BENCH_PORT          = 39017;   // 两次运行分别用 BENCH_PORT、BENCH_PORT+1
+static constexpr int      BENCH_LOOPBACK_MB   = 64;      // 默认测试数据量
+static constexpr int      BENCH_RECV_START_MS = 200;     // 等接收端绑定端口
+static const char* const  BENCH_INPUT  = "rudp_bench_in.bin";
+static const char* const  BENCH_OUTPUT = "rudp_bench_out.bin";
+
+// 传输过程中两端的日志和统计不输出，只看汇总（错误仍然写到 stderr）
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+};
+
+static bool writeBenchInput(uint64_t bytes)
+{
+    std::ofstream out(BENCH_INPUT, std::ios::binary);
+    std::mt19937_64 rng(SELFTEST_SEED);
+    std::vector<uint64_t> block(1 << 16);
+    for (uint64_t done = 0; done < bytes && out;)
+    {
+        for (uint64_t& w : block)
+            w = rng();
+        size_t n = static_cast<size_t>(
+            std::min<uint64_t>(bytes - done, block.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(n));
+        done += n;
+    }
+    return static_cast<bool>(out);
+}
+
+static bool sameContents(const char* a, const char* b)
+{
+    std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+    std::vector<char> ba(1 << 20), bb(1 << 20);
+    while (fa && fb)
+    {
+        fa.read(ba.data(), static_cast<std::streamsize>(ba.size()));
+        fb.read(bb.data(), static_cast<std::streamsize>(bb.size()));
+        if (fa.gcount() != fb.gcount() ||
+            std::memcmp(ba.data(), bb.data(), static_cast<size_t>(fa.gcount())) != 0)
+            return false;
+    }
+    return fa.eof() && fb.eof();
+}
+
+static double ratio(uint64_t num, uint64_t den)
+{
+    return den > 0 ? static_cast<double>(num) / static_cast<double>(den) : 0.0;
+}
+
+// 跑一次 send -> recv，返回是否成功（发送端确认 + 输出文件一致）
+static bool runLoopback(const char* name, bool registeredIo, uint16_t port, uint64_t bytes)
+{
+    g_registeredIo = registeredIo;
+    g_dataPath.reset();
+    std::remove(BENCH_OUTPUT);
+
+    NullBuffer      quiet;
+    std::streambuf* saved = std::cout.rdbuf(&quiet);
+    g_stopReceiver.store(false);
+    std::thread receiver([port]() { runReceiver(port, BENCH_OUTPUT); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_RECV_START_MS));
+    const auto start = std::chrono::steady_clock::now();
+    bool sent = runSender("127.0.0.1", port, BENCH_INPUT);
+    const auto end = std::chrono::steady_clock::now();
+    // 发送端放弃时接收端可能还在等 SYN（或等一个不会再来的分组），叫停它再汇合
+    if (!sent)
+        g_stopReceiver.store(true);
+    receiver.join();
+    std::cout.rdbuf(saved);
+
+    const bool   ok  = sent && sameContents(BENCH_INPUT, BENCH_OUTPUT);
+    const double sec = std::chrono::duration<double>(end - start).count();
+    const DataPathCounters& c = g_dataPath;
+    std::cout << name << (registeredIo && !(c.rioSender && c.rioReceiver)
+                              ? " (RIO unavailable, plain fallback)" : "")
+              << ": " << (ok ? "ok" : "FAILED") << ", "
+              << (sec > 0.0 ? static_cast<double>(bytes) / sec / (1024.0 * 1024.0) : 0.0)
+              << " MB/s (" << sec << " s)\n";
+    std::cout << "  tx batches:          " << c.txBatches << " (avg "
+              << ratio(c.txPackets, c.txBatches) << " pkts)\n";
+    std::cout << "  rx batches:          " << c.rxBatches << " (avg "
+              << ratio(c.rxPackets, c.rxBatches) << " pkts)\n";
+    if (c.rioSender || c.rioReceiver)
+    {
+        std::cout << "  RIO sends:           posted=" << c.rioSends << ", sendCommits="
+                  << c.rioCommits << " (avg " << ratio(c.rioSends, c.rioCommits)
+                  << " pkts), sendWaits=" << c.rioSendWaits << "\n";
+        std::cout << "  RIO receives:        reaped=" << c.rioRecvs << ", recvDequeues="
+                  << c.rioDequeues << " (avg " << ratio(c.rioRecvs, c.rioDequeues)
+                  << " per dequeue)\n";
+    }
+    return ok;
+}
+
+static bool benchLoopback(int megabytes)
+{
+    const uint64_t bytes = static_cast<uint64_t>(megabytes) << 20;
+    std::cout << "===== loopback send -> recv (" << megabytes << " MB, 127.0.0.1:"
+              << BENCH_PORT << ") =====\n";
+    if (!writeBenchInput(bytes))
+    {
+        std::cerr << "cannot write " << BENCH_INPUT << "\n";
+        return false;
+    }
+    const bool savedRio = g_registeredIo;
+    bool ok = runLoopback("plain", false, BENCH_PORT, bytes);
+    ok = runLoopback("rio", true, static_cast<uint16_t>(BENCH_PORT + 1), bytes) && ok;
+    g_registeredIo = savedRio;
+    std::remove(BENCH_INPUT);
+    std::remove(BENCH_OUTPUT);
+    return ok;
+}
+
+
+int runBenchmark(const std::vector<std::string>& args)
+{
+    const std::string what = args.empty() ? "all" : args[0];
+    bool ok = true;
+    if (what == "checksum" || what == "all")
+        benchChecksum();
+    if (what == "loopback" || what == "all")
+    {
+        int megabytes = args.size() > 1 ? std::stoi(args[1]) : BENCH_LOOPBACK_MB;
+        ok = benchLoopback(std::max(1, megabytes));
+    }
+    if (what != "checksum" && what != "loopback" && what != "all")
+    {
+        std::cerr << "unknown benchmark: " << what << "\n";
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
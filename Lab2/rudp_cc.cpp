@@ -0,0 +1,308 @@
+// rudp_cc.cpp —— 拥塞控制算法实现：Reno（默认）/ CUBIC / 简化 BBR
+#include "rudp_cc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+namespace
+{
+
+constexpr double INITIAL_CWND     = 1.0;    // 初始拥塞窗口（分组）
+constexpr double INITIAL_SSTHRESH = 16.0;   // 初始慢启动阈值（分组）
+constexpr double MIN_SSTHRESH     = 2.0;
+
+// ============ Reno：慢启动 + 拥塞避免 + 快速重传 / 快速恢复 ============
+
+class RenoController : public CongestionController
+{
+public:
+    const char* name() const override { return "reno"; }
+
+    // 按本 ACK 确认的分组数增长（而不是按 ACK 个数），接收端合并 ACK 时增长速度不变
+    void onAck(uint32_t ackedPackets, double, size_t, Clock::time_point) override
+    {
+        if (cwnd_ < ssthresh_)
+            cwnd_ += ackedPackets;             // 慢启动
+        else
+            cwnd_ += ackedPackets / cwnd_;     // 拥塞避免
+    }
+
+    void onDupAck() override
+    {
+        // 快速恢复阶段：每个重复 ACK 线性增大 cwnd
+        cwnd_ += 1.0;
+    }
+
+    void onLoss(Clock::time_point) override
+    {
+        // 退避并设置窗口到 ssthresh+3
+        ssthresh_ = std::max(cwnd_ / 2.0, MIN_SSTHRESH);
+        cwnd_     = ssthresh_ + 3.0;
+    }
+
+    void onRecoveryExit() override { cwnd_ = ssthresh_; }
+
+    void onTimeout(Clock::time_point) override
+    {
+        // 窗口减半，退回到慢启动/拥塞避免交界点
+        ssthresh_ = std::max(cwnd_ / 2.0, MIN_SSTHRESH);
+        cwnd_     = ssthresh_;
+    }
+
+    double cwnd() const override { return cwnd_; }
+    double ssthresh() const override { return ssthresh_; }
+
+private:
+    double cwnd_     = INITIAL_CWND;
+    double ssthresh_ = INITIAL_SSTHRESH;
+};
+
+// ============ CUBIC（RFC 8312）：窗口按距上次丢包的时间三次增长 ============
+
+class CubicController : public CongestionController
+{
+public:
+    const char* name() const override { return "cubic"; }
+
+    void onAck(uint32_t ackedPackets, double rttUs, size_t,
+               Clock::time_point now) override
+    {
+        if (rttUs > 0 && (minRttUs_ <= 0 || rttUs < minRttUs_))
+            minRttUs_ = rttUs;
+
+        if (cwnd_ < ssthresh_)
+        {
+            cwnd_ += ackedPackets;    // 慢启动
+            return;
+        }
+
+        if (!epochValid_)
+        {
+            // 新的拥塞避免周期：以上次丢包前的窗口 wMax 为平台
+            epochValid_  = true;
+            epochStart_  = now;
+            renoWnd_     = cwnd_;
+            if (cwnd_ < wMax_)
+            {
+                k_           = std::cbrt((wMax_ - cwnd_) / C);
+                originPoint_ = wMax_;
+            }
+            else
+            {
+                k_           = 0.0;
+                originPoint_ = cwnd_;
+            }
+        }
+
+        double t = std::chrono::duration<double>(now - epochStart_).count()
+                 + std::max(minRttUs_, 0.0) / 1e6;
+        double target = originPoint_ + C * std::pow(t - k_, 3.0);
+
+        // TCP 友好区：不比同样条件下的 Reno 慢
+        renoWnd_ += 3.0 * (1.0 - BETA) / (1.0 + BETA) * ackedPackets / cwnd_;
+        target = std::max(target, renoWnd_);
+
+        if (target > cwnd_)
+            cwnd_ += (target - cwnd_) / cwnd_ * ackedPackets;
+        else
+            cwnd_ += 0.01 * ackedPackets / cwnd_;
+    }
+
+    void onLoss(Clock::time_point) override { reduce(); }
+
+    void onTimeout(Clock::time_point) override { reduce(); }
+
+    double cwnd() const override { return cwnd_; }
+    double ssthresh() const override { return ssthresh_; }
+
+private:
+    static constexpr double C    = 0.4;
+    static constexpr double BETA = 0.7;
+
+    void reduce()
+    {
+        epochValid_ = false;
+        // 快速收敛：窗口还没恢复到上次的 wMax 就又丢包，说明有新流加入，主动让出带宽
+        if (cwnd_ < lastWMax_)
+        {
+            lastWMax_ = cwnd_;
+            wMax_     = cwnd_ * (1.0 + BETA) / 2.0;
+        }
+        else
+        {
+            lastWMax_ = cwnd_;
+            wMax_     = cwnd_;
+        }
+        ssthresh_ = std::max(cwnd_ * BETA, MIN_SSTHRESH);
+        cwnd_     = ssthresh_;
+    }
+
+    double cwnd_     = INITIAL_CWND;
+    double ssthresh_ = INITIAL_SSTHRESH;
+
+    double wMax_        = 0.0;
+    double lastWMax_    = 0.0;
+    double k_           = 0.0;
+    double originPoint_ = 0.0;
+    double renoWnd_     = 0.0;
+    double minRttUs_    = -1.0;
+
+    bool              epochValid_ = false;
+    Clock::time_point epochStart_;
+};
+
+// ============ 简化 BBR：按瓶颈带宽 × 最小 RTT 建模，不把丢包当作拥塞信号 ============
+
+class BbrController : public CongestionController
+{
+public:
+    const char* name() const override { return "bbr"; }
+
+    void onAck(uint32_t ackedPackets, double rttUs, size_t inFlight,
+               Clock::time_point now) override
+    {
+        // 最小 RTT：10 秒没有刷新就接受新样本
+        if (rttUs > 0 &&
+            (minRttUs_ <= 0 || rttUs <= minRttUs_ ||
+             now - minRttStamp_ > std::chrono::seconds(10)))
+        {
+            minRttUs_    = rttUs;
+            minRttStamp_ = now;
+        }
+
+        if (!roundStarted_)
+        {
+            roundStarted_ = true;
+            roundStart_   = now;
+        }
+        roundDelivered_ += ackedPackets;
+        if (btlBw_ <= 0)
+            startupCwnd_ += ackedPackets;   // 还没有带宽样本前按慢启动增长
+
+        // 每经过约一个最小 RTT 结束一轮，得到一个交付速率样本
+        double roundUs = std::max(minRttUs_, 1000.0);
+        double elapsedUs =
+            std::chrono::duration<double, std::micro>(now - roundStart_).count();
+        if (elapsedUs >= roundUs)
+        {
+            endRound(roundDelivered_ / (elapsedUs / 1e6));
+            roundStart_     = now;
+            roundDelivered_ = 0;
+        }
+
+        // 排空阶段：在途分组降到 BDP 以下就进入稳态
+        if (mode_ == Mode::Drain && static_cast<double>(inFlight) <= bdp())
+        {
+            mode_       = Mode::ProbeBw;
+            cycleIndex_ = 2;
+        }
+    }
+
+    void onLoss(Clock::time_point) override {}
+
+    void onTimeout(Clock::time_point) override
+    {
+        // 超时：本轮只保留最小窗口，等下一个速率样本再恢复
+        timeoutConserve_ = true;
+    }
+
+    double cwnd() const override
+    {
+        if (timeoutConserve_)
+            return MIN_CWND;
+        if (btlBw_ <= 0)
+            return std::max(startupCwnd_, INITIAL_CWND);
+        double gain = (mode_ == Mode::ProbeBw) ? 2.0 : HIGH_GAIN;
+        return std::max(gain * bdp(), MIN_CWND);
+    }
+
+    double ssthresh() const override { return 0.0; }
+
+    double pacingRate() const override
+    {
+        if (btlBw_ <= 0)
+            return 0.0;
+        return pacingGain() * btlBw_;
+    }
+
+private:
+    enum class Mode { Startup, Drain, ProbeBw };
+
+    static constexpr double HIGH_GAIN = 2.885;   // 2/ln2
+    static constexpr double MIN_CWND  = 4.0;
+    static constexpr size_t BW_WINDOW_ROUNDS = 10;
+    static constexpr double CYCLE_GAINS[8] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+    double bdp() const { return btlBw_ * std::max(minRttUs_, 0.0) / 1e6; }
+
+    double pacingGain() const
+    {
+        switch (mode_)
+        {
+        case Mode::Startup: return HIGH_GAIN;
+        case Mode::Drain:   return 1.0 / HIGH_GAIN;
+        default:            return CYCLE_GAINS[cycleIndex_];
+        }
+    }
+
+    void endRound(double rate)
+    {
+        timeoutConserve_ = false;
+
+        // 瓶颈带宽 = 最近 BW_WINDOW_ROUNDS 轮交付速率的最大值
+        bwSamples_.push_back(rate);
+        if (bwSamples_.size() > BW_WINDOW_ROUNDS)
+            bwSamples_.pop_front();
+        btlBw_ = *std::max_element(bwSamples_.begin(), bwSamples_.end());
+
+        if (mode_ == Mode::Startup)
+        {
+            // 连续 3 轮带宽增长不到 25%，认为管道已经填满
+            if (btlBw_ >= fullBw_ * 1.25)
+            {
+                fullBw_      = btlBw_;
+                fullBwCount_ = 0;
+            }
+            else if (++fullBwCount_ >= 3)
+            {
+                mode_ = Mode::Drain;
+            }
+        }
+        else if (mode_ == Mode::ProbeBw)
+        {
+            cycleIndex_ = (cycleIndex_ + 1) % 8;
+        }
+    }
+
+    Mode   mode_        = Mode::Startup;
+    size_t cycleIndex_  = 0;
+    double startupCwnd_ = INITIAL_CWND;
+
+    std::deque<double> bwSamples_;          // 每轮交付速率（分组/秒）
+    double btlBw_       = 0.0;
+    double fullBw_      = 0.0;
+    int    fullBwCount_ = 0;
+
+    double            minRttUs_ = -1.0;
+    Clock::time_point minRttStamp_;
+
+    bool              roundStarted_   = false;
+    Clock::time_point roundStart_;
+    double            roundDelivered_ = 0.0;
+
+    bool timeoutConserve_ = false;
+};
+
+} // namespace
+
+std::unique_ptr<CongestionController> makeCongestionController(const std::string& name)
+{
+    if (name == "reno")
+        return std::make_unique<RenoController>();
+    if (name == "cubic")
+        return std::make_unique<CubicController>();
+    if (name == "bbr")
+        return std::make_unique<BbrController>();
+    return nullptr;
+}
@@ -0,0 +1,50 @@
+// rudp_cc.h  —— 拥塞控制算法接口（Reno / CUBIC / BBR）
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+// 发送端在以下事件发生时回调拥塞控制器，窗口与速率都以“分组”为单位
+class CongestionController
+{
+public:
+    virtual ~CongestionController() = default;
+
+    virtual const char* name() const = 0;
+
+    // 收到确认了新分组的 ACK
+    //   ackedPackets：本 ACK 新确认的分组数（累计确认 + SACK）
+    //   rttUs：本 ACK 的 RTT 样本（微秒），没有有效样本时为负数
+    //   inFlight：处理完本 ACK 后仍在途的分组数
+    virtual void onAck(uint32_t ackedPackets, double rttUs,
+                       size_t inFlight, Clock::time_point now) = 0;
+
+    // 快速恢复期间每收到一个重复 ACK
+    virtual void onDupAck() {}
+
+    // 三次重复 ACK 判定丢包，进入快速恢复
+    virtual void onLoss(Clock::time_point now) = 0;
+
+    // 累计 ACK 越过恢复点，退出快速恢复
+    virtual void onRecoveryExit() {}
+
+    // 重传超时（同一批在途分组只回调一次）
+    virtual void onTimeout(Clock::time_point now) = 0;
+
+    // 拥塞窗口（分组数）
+    virtual double cwnd() const = 0;
+
+    // 慢启动阈值（分组数），仅用于统计输出
+    virtual double ssthresh() const = 0;
+
+    // 建议的发送速率（分组/秒），返回 0 表示算法不给出速率，由发送端按 cwnd/SRTT 推算
+    virtual double pacingRate() const { return 0.0; }
+};
+
+// 按名字创建拥塞控制器："reno"（默认）、"cubic"、"bbr"，名字无效时返回 nullptr
+std::unique_ptr<CongestionController> makeCongestionController(const std::string& name);
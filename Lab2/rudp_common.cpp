@@ -3,6 +3,15 @@
 
 #include <iostream>
 #include <cstring>
+#include <new>
+#include <array>
+#include <algorithm>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 #include <random>
 #include <thread>
@@ -19,6 +28,37 @@ void setRecvTimeout(SOCKET s, int ms)
 }
 
 
+int growSocketBuffer(SOCKET s, int optName, size_t bytes)
+{
+    int current = 0;
+    int len = sizeof(current);
+    getsockopt(s, SOL_SOCKET, optName, reinterpret_cast<char*>(&current), &len);
+    int want = static_cast<int>(std::min<size_t>(bytes, MAX_SOCKET_BUFFER));
+    if (want > current)
+    {
+        setsockopt(s, SOL_SOCKET, optName,
+                   reinterpret_cast<const char*>(&want), sizeof(want));
+        len = sizeof(current);
+        getsockopt(s, SOL_SOCKET, optName, reinterpret_cast<char*>(&current), &len);
+    }
+    return current;
+}
+
+
+bool setDontFragment(SOCKET s, bool on)
+{
+#ifdef IP_DONTFRAGMENT
+    DWORD value = on ? 1 : 0;
+    return setsockopt(s, IPPROTO_IP, IP_DONTFRAGMENT,
+                      reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+#else
+    (void)s;
+    (void)on;
+    return false;
+#endif
+}
+
+
 //打印网络错误信息
 void printLastError(const char* where)
 {
@@ -27,12 +67,166 @@ void printLastError(const char* where)
 }
 
 
+// ======================= 16 位互联网校验和 =======================
+// 反码求和与字节序无关（RFC 1071）：按本机小端 16 位字累加，最后回卷并交换两个字节，
+// 结果与逐个大端字相加、每步回卷完全一致。回卷可以推迟到最后：
+// 各内核先把 16 位字累加到 32/64 位累加器里，只在末尾折叠一次。
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RUDP_X86 1
+#endif
+
+// 标量内核：每次读 8 字节，拆成两个 32 位半字累加到 64 位累加器，不会溢出
+static uint64_t sumWords64(const char* data, size_t len)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        sum += (w & 0xFFFFFFFFu) + (w >> 32);
+    }
+    for (; i + 2 <= len; i += 2)
+    {
+        uint16_t w;
+        std::memcpy(&w, data + i, 2);
+        sum += w;
+    }
+    if (i < len)                            // 奇数字节：补 0 成一个字（小端下在低字节）
+        sum += static_cast<uint8_t>(data[i]);
+    return sum;
+}
+
+#ifdef RUDP_X86
+
+// 每个 32 位通道每轮最多加 2 * 0xFFFF，4096 轮内不会溢出，之后倒进 64 位累加器
+static constexpr size_t SIMD_FLUSH_ROUNDS = 4096;
+
+// SSE2 内核：一次 16 字节，16 位字零扩展成 32 位后按通道累加
+static uint64_t sumWordsSse2(const char* data, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 16 <= len)
+    {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t r = 0; r < SIMD_FLUSH_ROUNDS && i + 16 <= len; ++r, i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        sum += uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+    return sum + sumWords64(data + i, len - i);
+}
+
+// AVX2 内核：一次 32 字节
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+static uint64_t sumWordsAvx2(const char* data, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 32 <= len)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t r = 0; r < SIMD_FLUSH_ROUNDS && i + 32 <= len; ++r, i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+        }
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        for (uint32_t lane : lanes)
+            sum += lane;
+    }
+    // 尾部交给标量内核：紧接着跑非 VEX 编码的 SSE 代码会触发 AVX/SSE 状态切换开销
+    return sum + sumWords64(data + i, len - i);
+}
+
+// CPU 与操作系统都支持 AVX2 时才能用（OS 需要保存 YMM 寄存器）
+static bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // RUDP_X86
+
+using SumKernel = uint64_t (*)(const char*, size_t);
+
+// 运行时选择内核：AVX2 > SSE2（x86 的基线）> 标量
+static SumKernel selectSumKernel()
+{
+#ifdef RUDP_X86
+    if (cpuHasAvx2())
+        return sumWordsAvx2;
+    return sumWordsSse2;
+#else
+    return sumWords64;
+#endif
+}
+
+static uint64_t sumWords(const char* data, size_t len)
+{
+    static const SumKernel kernel = selectSumKernel();
+    return kernel(data, len);
+}
+
+// 折叠到 16 位并换回大端字序，得到反码和（不取反）
+static uint16_t foldSum(uint64_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    uint16_t s = static_cast<uint16_t>(sum);
+    return static_cast<uint16_t>((s << 8) | (s >> 8));
+}
+
+
+const char* checksumKernelName()
+{
+#ifdef RUDP_X86
+    return selectSumKernel() == sumWordsAvx2 ? "avx2" : "sse2";
+#else
+    return "scalar64";
+#endif
+}
+
+
 // 16 位互联网校验和
 uint16_t checksum16(const char* data, size_t len)
+{
+    //按位取反得到校验值
+    return static_cast<uint16_t>(~foldSum(sumWords(data, len)));
+}
+
+
+// 原来的逐字实现：按 16 位大端字累加，每步回卷。各内核的自检以它为准
+uint16_t checksum16Reference(const char* data, size_t len)
 {
     uint32_t sum = 0;
     size_t i = 0;
-
     while (i + 1 < len)
     {
         uint16_t word =
@@ -43,7 +237,6 @@ uint16_t checksum16(const char* data, size_t len)
             sum = (sum & 0xFFFF) + 1;
         i += 2;
     }
-
     if (i < len)                            // 奇数字节
     {
         uint16_t word = static_cast<uint8_t>(data[i]) << 8;
@@ -51,85 +244,601 @@ uint16_t checksum16(const char* data, size_t len)
         if (sum & 0x10000)
             sum = (sum & 0xFFFF) + 1;
     }
-    //按位取反得到校验值
     return static_cast<uint16_t>(~sum);
 }
 
 
-bool sendPacket(
+template <SumKernel Kernel>
+static uint16_t checksumWith(const char* data, size_t len)
+{
+    return static_cast<uint16_t>(~foldSum(Kernel(data, len)));
+}
+
+std::vector<ChecksumKernel> checksumKernels()
+{
+    std::vector<ChecksumKernel> kernels{{"scalar64", checksumWith<sumWords64>}};
+#ifdef RUDP_X86
+    kernels.push_back({"sse2", checksumWith<sumWordsSse2>});
+    if (cpuHasAvx2())
+        kernels.push_back({"avx2", checksumWith<sumWordsAvx2>});
+#endif
+    return kernels;
+}
+
+
+// ======================= CRC32C =======================
+// Castagnoli 多项式（反射形式 0x82F63B78）。SSE4.2 的 crc32 指令直接计算它，
+// 没有该指令时用查表法。crc32c(crc32c(0, a), b) == crc32c(0, a 后接 b)。
+
+static uint32_t crc32cSoftware(uint32_t crc, const char* data, size_t len)
+{
+    static const auto table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i)
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef RUDP_X86
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t crc32cSse42(uint32_t crc, const char* data, size_t len)
+{
+    crc = ~crc;
+    size_t i = 0;
+#if defined(_M_X64) || defined(__x86_64__)
+    uint64_t c64 = crc;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        c64 = _mm_crc32_u64(c64, w);
+    }
+    crc = static_cast<uint32_t>(c64);
+#endif
+    for (; i + 4 <= len; i += 4)
+    {
+        uint32_t w;
+        std::memcpy(&w, data + i, 4);
+        crc = _mm_crc32_u32(crc, w);
+    }
+    for (; i < len; ++i)
+        crc = _mm_crc32_u8(crc, static_cast<uint8_t>(data[i]));
+    return ~crc;
+}
+
+static bool cpuHasSse42()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#endif // RUDP_X86
+
+using CrcKernel = uint32_t (*)(uint32_t, const char*, size_t);
+
+static CrcKernel selectCrcKernel()
+{
+#ifdef RUDP_X86
+    if (cpuHasSse42())
+        return crc32cSse42;
+#endif
+    return crc32cSoftware;
+}
+
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t len)
+{
+    static const CrcKernel kernel = selectCrcKernel();
+    return kernel(crc, data, len);
+}
+
+
+const char* crc32cKernelName()
+{
+    return selectCrcKernel() == crc32cSoftware ? "table" : "sse4.2";
+}
+
+
+void xorBytes(char* dst, const char* src, size_t len)
+{
+    // 按 64 位字异或，编译器会向量化；memcpy 避免未对齐访问
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t a, b;
+        std::memcpy(&a, dst + i, 8);
+        std::memcpy(&b, src + i, 8);
+        a ^= b;
+        std::memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; ++i)
+        dst[i] ^= src[i];
+}
+
+
+// ======================= 分组缓冲池 =======================
+
+PacketPool::PacketPool(size_t slabSize, size_t slabCount)
+    // 块大小向上取整到缓存行，保证每一块都从缓存行边界开始
+    : slabSize_((slabSize + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE),
+      slabCount_(slabCount)
+{
+    base_ = static_cast<char*>(::operator new(
+        slabSize_ * slabCount_, std::align_val_t(CACHE_LINE)));
+    freeList_.reserve(slabCount_);
+    for (size_t i = slabCount_; i > 0; --i)
+        freeList_.push_back(base_ + (i - 1) * slabSize_);
+}
+
+
+PacketPool::~PacketPool()
+{
+    ::operator delete(base_, std::align_val_t(CACHE_LINE));
+}
+
+
+char* PacketPool::acquire()
+{
+    if (freeList_.empty())
+        return nullptr;
+    char* slab = freeList_.back();
+    freeList_.pop_back();
+    return slab;
+}
+
+
+void PacketPool::release(char* slab)
+{
+    freeList_.push_back(slab);
+}
+
+
+RecvBatch::RecvBatch(size_t maxDatagrams, size_t slabBytes)
+    : pool(slabBytes, maxDatagrams)
+{
+    held.reserve(maxDatagrams);
+    items.reserve(maxDatagrams);
+}
+
+
+//设置套接字阻塞 / 非阻塞模式
+void setNonBlocking(SOCKET s, bool on)
+{
+    u_long mode = on ? 1 : 0;
+    ioctlsocket(s, FIONBIO, &mode);
+}
+
+
+// 填写 hdr.len 和校验信息，返回线上头部长度：
+//   普通分组：头部（16 字节，偶数长度）和负载分两段累加 16 位校验和
+//   FLAG_CRC32C 分组：checksum 置 0，头部 + 负载的 CRC32C 写进扩展头部
+// 负载都留在调用方的缓冲区里原地参与计算
+static size_t sealHeader(ExtPacketHeader& wire, const char* payload, uint16_t payloadLen)
+{
+    PacketHeader& hdr = wire.base;
+    hdr.len      = payloadLen;
+    hdr.checksum = 0;
+
+    if (hdr.flags & FLAG_CRC32C)
+    {
+        uint32_t crc = crc32c(0, reinterpret_cast<const char*>(&hdr), sizeof(PacketHeader));
+        if (payloadLen > 0 && payload != nullptr)
+            crc = crc32c(crc, payload, payloadLen);
+        wire.crc = crc;
+        return sizeof(ExtPacketHeader);
+    }
+
+    uint64_t sum = sumWords(reinterpret_cast<const char*>(&hdr), sizeof(PacketHeader));
+    if (payloadLen > 0 && payload != nullptr)
+        sum += sumWords(payload, payloadLen);
+    hdr.checksum = static_cast<uint16_t>(~foldSum(sum));
+    return sizeof(PacketHeader);
+}
+
+
+static WSABUF makeBuf(const void* data, size_t len)
+{
+    WSABUF buf;
+    buf.buf = static_cast<char*>(const_cast<void*>(data));
+    buf.len = static_cast<ULONG>(len);
+    return buf;
+}
+
+
+//聚集发送：多段缓冲区由协议栈拼成一个数据报
+static bool sendGather(
+    SOCKET s,
+    const sockaddr_in& addr,
+    WSABUF* bufs,
+    size_t bufCount)
+{
+    DWORD sent = 0;
+    int ret = WSASendTo(
+        s,
+        bufs,
+        static_cast<DWORD>(bufCount),
+        &sent,
+        0,
+        reinterpret_cast<const sockaddr*>(&addr),
+        sizeof(addr),
+        nullptr,
+        nullptr);
+
+    if (ret == SOCKET_ERROR)
+    {
+        printLastError("WSASendTo");
+        return false;
+    }
+    return true;
+}
+
+
+// 真正发出一个分组（不做丢包 / 延迟模拟）：头部在栈上，负载直接引用调用方缓冲区
+static bool sendRaw(
     SOCKET s,
     const sockaddr_in& addr,
     PacketHeader hdr,
     const char* payload,
     uint16_t payloadLen)
 {
-    // ===== 模拟丢包 / 延迟的随机数 =====
-    //定义线程本地的随机数引擎rng,保证每个线程有独立的随机数序列
-    static thread_local std::mt19937 rng{std::random_device{}()};
+    ExtPacketHeader wire{};
+    wire.base = hdr;
+    size_t hdrLen = sealHeader(wire, payload, payloadLen);
+
+    WSABUF bufs[2];
+    size_t bufCount = 0;
+    bufs[bufCount++] = makeBuf(&wire, hdrLen);
+    if (payloadLen > 0 && payload != nullptr)
+        bufs[bufCount++] = makeBuf(payload, payloadLen);
+    return sendGather(s, addr, bufs, bufCount);
+}
 
-    bool isPureAck = (hdr.flags & FLAG_ACK) && !(hdr.flags & FLAG_DATA)
-                     && !(hdr.flags & FLAG_SYN) && !(hdr.flags & FLAG_FIN);
 
-    // 把真正 send 的逻辑封装成一个小函数，方便复用
-    auto do_real_send = [&]() -> bool {
-        hdr.len      = payloadLen;
-        hdr.checksum = 0;
+// 校验 pkt 处长度为 len 的分组，通过则把头部拷到 hdr
+static bool verifyPacket(const char* pkt, size_t len, PacketHeader& hdr)
+{
+    //如果一个完整的头部都没有收到，则报文无效
+    if (len < sizeof(PacketHeader))
+    {
+        std::cerr << "[recvPacket] packet too short\n";
+        return false;
+    }
 
-        //总长度
-        const size_t totalLen = sizeof(PacketHeader) + payloadLen;
-        std::vector<char> buffer(totalLen);
+    // 拷贝头部
+    PacketHeader wireHdr{};
+    std::memcpy(&wireHdr, pkt, sizeof(PacketHeader));
+    uint16_t recvChecksum = wireHdr.checksum;
 
-        std::memcpy(buffer.data(), &hdr, sizeof(PacketHeader));
-        if (payloadLen > 0 && payload != nullptr)
+    // 协商了 CRC32C 的分组：头部后是 4 字节 CRC，checksum 字段必须为 0
+    if (wireHdr.flags & FLAG_CRC32C)
+    {
+        if (len < sizeof(ExtPacketHeader))
         {
-            //拷贝负载数据
-            std::memcpy(buffer.data() + sizeof(PacketHeader),
-                        payload, payloadLen);
+            std::cerr << "[recvPacket] packet too short\n";
+            return false;
         }
-
-        // 计算校验和
-        hdr.checksum = checksum16(buffer.data(), buffer.size());
-        std::memcpy(buffer.data(), &hdr, sizeof(PacketHeader));
-        //发送数据报
-        int ret = sendto(
-            s,
-            buffer.data(),
-            static_cast<int>(buffer.size()),
-            0,
-            reinterpret_cast<const sockaddr*>(&addr),
-            sizeof(addr));
-
-        if (ret == SOCKET_ERROR)
+        uint32_t recvCrc = 0;
+        std::memcpy(&recvCrc, pkt + sizeof(PacketHeader), sizeof(recvCrc));
+        uint32_t calcCrc = crc32c(0, pkt, sizeof(PacketHeader));
+        calcCrc = crc32c(calcCrc, pkt + sizeof(ExtPacketHeader),
+                         len - sizeof(ExtPacketHeader));
+        if (recvCrc != calcCrc || recvChecksum != 0)
         {
-            printLastError("sendto");
+            std::cerr << "[recvPacket] crc32c error\n";
             return false;
         }
+        hdr = wireHdr;
         return true;
-    };
+    }
 
-    // ================= 纯 ACK：不丢包，不延迟 =================
-    if (isPureAck)
+    // 重新计算校验和：整包一次累加，再减掉校验和字段自己的贡献，
+    // 等价于把该字段置 0 后计算，但不用改写接收缓冲区
+    uint64_t sum = sumWords(pkt, len) - recvChecksum;
+    uint16_t calcChecksum = static_cast<uint16_t>(~foldSum(sum));
+    //如果重新计算出来的和原本的一样，则没有错误
+    if (recvChecksum != calcChecksum)
     {
-        return do_real_send();
+        std::cerr << "[recvPacket] checksum error\n";
+        return false;
     }
 
-    // ================= 其他包：按设置丢包 + 延迟 =================
-    //每次调用dist(rng)生成一个[0.0,1.0)之间的均匀分布随机数
-    std::uniform_real_distribution<double> dist(0.0, 1.0);
-    if (dist(rng) < g_lossRate)
+    hdr = wireHdr;
+    return true;
+}
+
+
+// ======================= 事件等待 =======================
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002   // 旧版 SDK 没有这个定义
+#endif
+
+// 高精度定时器（Windows 10 1803 起）不受系统时钟粒度限制，不支持时退回普通定时器
+static HANDLE createDeadlineTimer(bool& highRes)
+{
+    HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr,
+                                          CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                          TIMER_ALL_ACCESS);
+    highRes = timer != nullptr;
+    if (!timer)
+        timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    return timer;
+}
+
+
+SocketWaiter::SocketWaiter(SOCKET s) : s_(s)
+{
+    readEvent_ = WSACreateEvent();
+    if (readEvent_ == WSA_INVALID_EVENT || WSAEventSelect(s_, readEvent_, FD_READ) != 0)
+        printLastError("WSAEventSelect");
+    timer_ = createDeadlineTimer(highRes_);
+}
+
+
+SocketWaiter::SocketWaiter(HANDLE readyEvent) : readEvent_(readyEvent)
+{
+    timer_ = createDeadlineTimer(highRes_);
+}
+
+
+SocketWaiter::~SocketWaiter()
+{
+    if (s_ != INVALID_SOCKET && readEvent_ != WSA_INVALID_EVENT)
     {
-        // 丢包：什么都不发，直接返回 true
+        WSAEventSelect(s_, nullptr, 0);
+        WSACloseEvent(readEvent_);
+    }
+    if (timer_)
+        CloseHandle(timer_);
+}
+
+
+bool SocketWaiter::wait(TimePoint deadline)
+{
+    HANDLE handles[2] = {readEvent_, timer_};
+    DWORD  count = 1;
+    DWORD  waitMs = INFINITE;
+    if (deadline != TimePoint::max())
+    {
+        auto until = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (until <= 0)
+        {
+            waitMs = 0;
+        }
+        else if (timer_)
+        {
+            // 相对时间，单位 100ns，负数表示相对当前时刻
+            LARGE_INTEGER due{};
+            due.QuadPart = -std::max<LONGLONG>(1, until / 100);
+            SetWaitableTimer(timer_, &due, 0, nullptr, nullptr, FALSE);
+            count = 2;
+        }
+        else
+        {
+            waitMs = static_cast<DWORD>((until + 999999) / 1000000);
+        }
+    }
+
+    DWORD ret = WaitForMultipleObjects(count, handles, FALSE, waitMs);
+    if (waitMs != 0)
+        ++wakeups_;
+    if (ret == WAIT_OBJECT_0)
+    {
+        // 取走网络事件记录并复位事件；数据报留给调用方收，没收完时下一次 recvfrom 会重新置位
+        if (s_ != INVALID_SOCKET)
+        {
+            WSANETWORKEVENTS events{};
+            WSAEnumNetworkEvents(s_, readEvent_, &events);
+        }
+        if (count == 2)
+            CancelWaitableTimer(timer_);
         return true;
     }
+    if (waitMs != 0)
+        ++timerWakeups_;
+    return false;
+}
+
+
+// ======================= UDP 分段卸载（USO / URO） =======================
+// Windows 10 起 UDP 支持发送分段卸载（UDP_SEND_MSG_SIZE）和接收合并（UDP_RECV_MAX_COALESCED_SIZE），
+// 相当于 Linux 的 UDP_SEGMENT / UDP_GRO：一个大缓冲区由协议栈切成多个等长数据报发出，
+// 接收端则可能一次收到多个首尾相接的数据报，按 PacketHeader 的 len 字段拆开
+
+bool enableSendOffload(SOCKET s, uint16_t segmentSize)
+{
+    DWORD value = segmentSize;
+    return setsockopt(s, IPPROTO_UDP, UDP_SEND_MSG_SIZE,
+                      reinterpret_cast<const char*>(&value),
+                      sizeof(value)) == 0;
+}
+
+
+bool enableRecvOffload(SOCKET s, bool on)
+{
+    DWORD value = on ? MAX_OFFLOAD_BYTES : 0;
+    return setsockopt(s, IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+                      reinterpret_cast<const char*>(&value),
+                      sizeof(value)) == 0;
+}
+
+
+static bool isPureAck(const PacketHeader& hdr)
+{
+    return (hdr.flags & FLAG_ACK) && !(hdr.flags & FLAG_DATA)
+           && !(hdr.flags & FLAG_SYN) && !(hdr.flags & FLAG_FIN);
+}
+
+
+// 模拟丢包：返回 true 表示这个分组应当被丢弃
+static bool emulateLoss()
+{
+    // ===== 模拟丢包 / 延迟的随机数 =====
+    //定义线程本地的随机数引擎rng,保证每个线程有独立的随机数序列
+    static thread_local std::mt19937 rng{std::random_device{}()};
+
+    //每次调用dist(rng)生成一个[0.0,1.0)之间的均匀分布随机数
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    return dist(rng) < g_lossRate;
+}
+
 
-    //人为制造发送延迟，模拟网络链路时延
+//人为制造发送延迟，模拟网络链路时延
+static void emulateDelay()
+{
     if (g_linkDelayMs > 0)
     {
         std::this_thread::sleep_for(
             std::chrono::milliseconds(g_linkDelayMs));
     }
+}
+
+
+bool emulateLinkInBatch(const PacketHeader& hdr, bool& delayed)
+{
+    if (isPureAck(hdr))
+        return true;
+    if (emulateLoss())
+        return false;
+    if (!delayed)
+    {
+        emulateDelay();
+        delayed = true;
+    }
+    return true;
+}
+
+
+size_t sealPacket(char* out, PacketHeader hdr, const char* payload, uint16_t payloadLen)
+{
+    ExtPacketHeader wire{};
+    wire.base = hdr;
+    size_t hdrLen = sealHeader(wire, payload, payloadLen);
+    std::memcpy(out, &wire, hdrLen);
+    if (payloadLen > 0 && payload != nullptr)
+        std::memcpy(out + hdrLen, payload, payloadLen);
+    return hdrLen + payloadLen;
+}
+
+
+bool sendPacket(
+    SOCKET s,
+    const sockaddr_in& addr,
+    PacketHeader hdr,
+    const char* payload,
+    uint16_t payloadLen)
+{
+    // ================= 纯 ACK：不丢包，不延迟 =================
+    if (isPureAck(hdr))
+    {
+        return sendRaw(s, addr, hdr, payload, payloadLen);
+    }
+
+    // ================= 其他包：按设置丢包 + 延迟 =================
+    if (emulateLoss())
+    {
+        // 丢包：什么都不发，直接返回 true
+        return true;
+    }
 
-    return do_real_send();
+    emulateDelay();
+    return sendRaw(s, addr, hdr, payload, payloadLen);
+}
+
+
+bool sendPacketBatch(
+    SOCKET s,
+    const sockaddr_in& addr,
+    const OutPacket* pkts,
+    size_t count,
+    uint16_t segmentSize,
+    size_t* sendCalls)
+{
+    // 超级数据报：分段卸载模式下把连续的等长分组首尾相接，一次 WSASendTo 交给协议栈切分；
+    // 只有头部放在这里，负载仍然聚集引用调用方缓冲区，不拷贝
+    static thread_local ExtPacketHeader superHdr[MAX_OFFLOAD_SEGMENTS];
+    static thread_local WSABUF       superBufs[2 * MAX_OFFLOAD_SEGMENTS];
+    size_t superLen   = 0;
+    size_t superSegs  = 0;
+    size_t superCount = 0;   // superBufs 已用段数
+    size_t calls      = 0;
+
+    auto flushSuper = [&]() -> bool
+    {
+        if (superSegs == 0)
+            return true;
+        ++calls;
+        bool ok = sendGather(s, addr, superBufs, superCount);
+        superLen   = 0;
+        superSegs  = 0;
+        superCount = 0;
+        return ok;
+    };
+
+    // 一批分组一起经过模拟链路：逐个按丢包率丢弃，整批只延迟一次
+    bool delayed = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const OutPacket& p = pkts[i];
+        if (!emulateLinkInBatch(p.hdr, delayed))
+            continue;
+
+        size_t pktLen = headerBytes(p.hdr.flags) + p.payloadLen;
+        if (segmentSize == 0 || pktLen > segmentSize)
+        {
+            // 未开启卸载，或分组比分段还大：单独发送
+            if (!flushSuper())
+                return false;
+            ++calls;
+            if (!sendRaw(s, addr, p.hdr, p.payload, p.payloadLen))
+                return false;
+            continue;
+        }
+
+        if (superLen + pktLen > MAX_OFFLOAD_BYTES ||
+            superSegs >= MAX_OFFLOAD_SEGMENTS)
+        {
+            if (!flushSuper())
+                return false;
+        }
+        ExtPacketHeader& wire = superHdr[superSegs];
+        wire.base = p.hdr;
+        size_t hdrLen = sealHeader(wire, p.payload, p.payloadLen);
+        superBufs[superCount++] = makeBuf(&wire, hdrLen);
+        if (p.payloadLen > 0 && p.payload != nullptr)
+            superBufs[superCount++] = makeBuf(p.payload, p.payloadLen);
+        superLen += pktLen;
+        ++superSegs;
+
+        // 只有最后一段可以比分段大小短，短分组之后必须结束本个超级缓冲区
+        if (pktLen < segmentSize && !flushSuper())
+            return false;
+    }
+    bool ok = flushSuper();
+    if (sendCalls)
+        *sendCalls += calls;
+    return ok;
 }
 
 
@@ -141,15 +850,15 @@ bool recvPacket(
     std::vector<char>& payload,
     sockaddr_in& from)
 {
-    //准备缓冲区和来源地址长度
-    char buffer[sizeof(PacketHeader) + MAX_PAYLOAD];
+    //准备缓冲区和来源地址长度：协商负载后分组可能比默认大，按最大数据报准备（每线程一块）
+    static thread_local std::vector<char> buffer(MAX_OFFLOAD_BYTES);
     int  fromLen = sizeof(from);
 
     //长度为ret
     int ret = recvfrom(
         s,
-        buffer,
-        sizeof(buffer),
+        buffer.data(),
+        static_cast<int>(buffer.size()),
         0,
         reinterpret_cast<sockaddr*>(&from),
         &fromLen);
@@ -165,34 +874,96 @@ bool recvPacket(
         printLastError("recvfrom");
         return false;
     }
-    //如果一个完整的头部都没有收到，则报文无效
-    if (ret < static_cast<int>(sizeof(PacketHeader)))
-    {
-        std::cerr << "[recvPacket] packet too short\n";
+    if (!verifyPacket(buffer.data(), static_cast<size_t>(ret), hdr))
         return false;
-    }
 
-    // 拷贝头部
-    PacketHeader wireHdr{};
-    std::memcpy(&wireHdr, buffer, sizeof(PacketHeader));
-    uint16_t recvChecksum = wireHdr.checksum;
+    //计算数据部分长度
+    const size_t hdrLen = headerBytes(hdr.flags);
+    int payloadLen = ret - static_cast<int>(hdrLen);
+    payload.assign(buffer.data() + hdrLen,
+                   buffer.data() + hdrLen + payloadLen);
+    return true;
+}
 
-    // 重新计算校验和
-    reinterpret_cast<PacketHeader*>(buffer)->checksum = 0;
-    uint16_t calcChecksum = checksum16(buffer, ret);
-    //如果重新计算出来的和原本的一样，则没有错误
-    if (recvChecksum != calcChecksum)
+
+size_t recvPacketBatch(
+    SOCKET s,
+    RecvBatch& batch,
+    size_t maxCount)
+{
+    // 上一批分组调用方已经处理完，缓冲块整批归还
+    for (char* slab : batch.held)
+        batch.pool.release(slab);
+    batch.held.clear();
+    batch.items.clear();
+
+    // 最多调用 maxCount 次 recvfrom：坏包之后可能还有正常分组，取空（WOULDBLOCK）才提前结束
+    for (size_t attempt = 0; attempt < maxCount; ++attempt)
     {
-        std::cerr << "[recvPacket] checksum error\n";
-        return false;
+        // 每个数据报直接收进一个缓冲块，分组负载原地交给调用方
+        char* slab = batch.pool.acquire();
+        if (slab == nullptr)
+            break;
+
+        sockaddr_in from{};
+        int fromLen = sizeof(from);
+        int ret = recvfrom(
+            s,
+            slab,
+            static_cast<int>(batch.pool.slabSize()),
+            0,
+            reinterpret_cast<sockaddr*>(&from),
+            &fromLen);
+
+        if (ret == SOCKET_ERROR)
+        {
+            batch.pool.release(slab);
+            int err = WSAGetLastError();
+            if (err == WSAEWOULDBLOCK || err == WSAETIMEDOUT)
+                break;
+            printLastError("recvfrom");
+            continue;
+        }
+        batch.held.push_back(slab);
+        parseDatagram(slab, static_cast<size_t>(ret), from, batch.items);
     }
+    return batch.items.size();
+}
 
-    hdr = wireHdr;
-    //计算数据部分长度
-    int payloadLen = ret - static_cast<int>(sizeof(PacketHeader));
-    payload.assign(buffer + sizeof(PacketHeader),
-                   buffer + sizeof(PacketHeader) + payloadLen);
-    return true;
+
+size_t parseDatagram(
+    const char* data,
+    size_t len,
+    const sockaddr_in& from,
+    std::vector<RecvItem>& items)
+{
+    // 按头部 len 字段切分；普通数据报只切出一个分组
+    size_t added = 0;
+    size_t off = 0;
+    while (off + sizeof(PacketHeader) <= len)
+    {
+        PacketHeader wireHdr{};
+        std::memcpy(&wireHdr, data + off, sizeof(PacketHeader));
+        size_t pktLen = headerBytes(wireHdr.flags) + wireHdr.len;
+        if (off + pktLen > len)
+        {
+            std::cerr << "[recvPacket] bad segment length\n";
+            break;
+        }
+
+        RecvItem item;
+        const char* pkt = data + off;
+        if (verifyPacket(pkt, pktLen, item.hdr))
+        {
+            item.payload    = pkt + headerBytes(item.hdr.flags);
+            item.payloadLen = item.hdr.len;
+            item.from       = from;
+            items.push_back(item);
+            ++added;
+        }
+        off += pktLen;
+    }
+    return added;
 }
 
 
@@ -204,7 +975,8 @@ void setLinkOptions(int delayMs, double lossRate)
     g_linkDelayMs = delayMs;
     g_lossRate    = lossRate;
 
-    // 简单粗暴：数据阶段一律 300ms 超时，足够覆盖轮询 + 模拟延迟
+    // 数据阶段初始 RTO 300ms，足够覆盖轮询 + 模拟延迟；
+    // 收到 RTT 样本后由发送端的 RTT 估计器自适应调整
     g_dataTimeoutMs = 300;
 
     std::cout << "[opts] delay=" << g_linkDelayMs
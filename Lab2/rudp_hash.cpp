@@ -0,0 +1,143 @@
+// rudp_hash.cpp —— XXH64（按 xxHash 规范实现，与官方实现结果一致）
+#include "rudp_hash.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const char* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, 8);    // 小端平台，按规范即为小端读取
+    return v;
+}
+
+inline uint32_t read32(const char* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t xxRound(uint64_t acc, uint64_t input)
+{
+    acc += input * P2;
+    acc  = rotl(acc, 31);
+    return acc * P1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= xxRound(0, val);
+    return acc * P1 + P4;
+}
+
+} // namespace
+
+Xxh64::Xxh64(uint64_t seed)
+    : seed_(seed)
+{
+    v_[0] = seed + P1 + P2;
+    v_[1] = seed + P2;
+    v_[2] = seed;
+    v_[3] = seed - P1;
+}
+
+
+void Xxh64::update(const char* data, size_t len)
+{
+    total_ += len;
+
+    // 先把上次剩下的尾部补满 32 字节
+    if (bufLen_ > 0)
+    {
+        size_t n = (len < 32 - bufLen_) ? len : 32 - bufLen_;
+        std::memcpy(buf_ + bufLen_, data, n);
+        bufLen_ += n;
+        data    += n;
+        len     -= n;
+        if (bufLen_ < 32)
+            return;
+        for (int i = 0; i < 4; ++i)
+            v_[i] = xxRound(v_[i], read64(buf_ + 8 * i));
+        bufLen_ = 0;
+    }
+
+    // 主循环：每 32 字节四路并行
+    while (len >= 32)
+    {
+        v_[0] = xxRound(v_[0], read64(data));
+        v_[1] = xxRound(v_[1], read64(data + 8));
+        v_[2] = xxRound(v_[2], read64(data + 16));
+        v_[3] = xxRound(v_[3], read64(data + 24));
+        data += 32;
+        len  -= 32;
+    }
+
+    std::memcpy(buf_, data, len);
+    bufLen_ = len;
+}
+
+
+uint64_t Xxh64::digest() const
+{
+    uint64_t h;
+    if (total_ >= 32)
+    {
+        h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = mergeRound(h, v_[i]);
+    }
+    else
+    {
+        h = seed_ + P5;
+    }
+    h += total_;
+
+    const char* p   = buf_;
+    size_t      len = bufLen_;
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        h ^= xxRound(0, read64(p));
+        h  = rotl(h, 27) * P1 + P4;
+    }
+    if (len >= 4)
+    {
+        h ^= static_cast<uint64_t>(read32(p)) * P1;
+        h  = rotl(h, 23) * P2 + P3;
+        p   += 4;
+        len -= 4;
+    }
+    for (; len > 0; ++p, --len)
+    {
+        h ^= static_cast<uint8_t>(*p) * P5;
+        h  = rotl(h, 11) * P1;
+    }
+
+    // 雪崩
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+std::string digestHex(uint64_t digest)
+{
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx",
+                  static_cast<unsigned long long>(digest));
+    return text;
+}
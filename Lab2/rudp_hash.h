@@ -0,0 +1,31 @@
+// rudp_hash.h —— 文件摘要：流式 XXH64，发送端边分组边算，接收端边按序写入边算
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// FIN 负载：8 字节 XXH64 文件摘要。发送端的 FIN 带源文件摘要，
+// 接收端的 FIN 带它按序写入的数据的摘要；没有负载表示对端没有给出摘要
+inline constexpr size_t FIN_DIGEST_BYTES = sizeof(uint64_t);
+
+class Xxh64
+{
+public:
+    explicit Xxh64(uint64_t seed = 0);
+
+    void     update(const char* data, size_t len);
+    uint64_t digest() const;          // 不改变内部状态，可以随时取当前摘要
+
+    uint64_t totalBytes() const { return total_; }
+
+private:
+    uint64_t v_[4];
+    char     buf_[32];                // 不满 32 字节的尾部
+    size_t   bufLen_ = 0;
+    uint64_t total_  = 0;
+    uint64_t seed_;
+};
+
+// 16 位十六进制字符串，用于统计输出
+std::string digestHex(uint64_t digest);
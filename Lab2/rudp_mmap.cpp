@@ -0,0 +1,82 @@
+// rudp_mmap.cpp —— 发送端输入文件的只读内存映射
+#include "rudp_mmap.h"
+
+#include <algorithm>
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+bool MappedFile::open(const std::string& path)
+{
+    // FILE_FLAG_SEQUENTIAL_SCAN：告诉缓存管理器按顺序读，加大预读
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(file_, &fileSize))
+    {
+        close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(fileSize.QuadPart);
+    if (size_ == 0)
+        return true;   // 长度为 0 的文件不能建映射，按空文件处理
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr)
+    {
+        close();
+        return false;
+    }
+    view_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (view_ == nullptr)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void MappedFile::prefetch(uint64_t offset, uint64_t len)
+{
+    uint64_t end = std::min(offset + len, size_);
+    offset = std::max(offset, prefetchedEnd_);
+    if (view_ == nullptr || offset >= end)
+        return;
+
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<char*>(view_ + offset);
+    range.NumberOfBytes  = static_cast<SIZE_T>(end - offset);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    ++prefetchCalls_;
+#endif
+    prefetchedEnd_ = end;
+}
+
+
+void MappedFile::close()
+{
+    if (view_ != nullptr)
+    {
+        UnmapViewOfFile(view_);
+        view_ = nullptr;
+    }
+    if (mapping_ != nullptr)
+    {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    if (file_ != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+    size_ = 0;
+}
@@ -0,0 +1,41 @@
+// rudp_mmap.h —— 发送端输入文件的只读内存映射
+#pragma once
+#include "rudp.h"
+#include <windows.h>
+
+#include <cstdint>
+#include <string>
+
+inline constexpr uint64_t MMAP_PREFETCH_BYTES = 4ull << 20;   // 每次预读 4MB
+
+// 把整个输入文件映射成只读视图，DATA 分组的负载直接引用映射中的字节：
+// 用户态不再拷贝文件内容，重传时重新从映射读取，发送环不必保留副本
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 空文件也返回 true（data() 为 nullptr，size() 为 0）
+    bool open(const std::string& path);
+    void close();
+
+    const char* data() const { return view_; }
+    uint64_t    size() const { return size_; }
+
+    // 顺序读提示：把 [offset, offset + len) 提前调入内存（PrefetchVirtualMemory），
+    // 已经提示过的范围不重复提交
+    void prefetch(uint64_t offset, uint64_t len);
+    uint64_t prefetchCalls() const { return prefetchCalls_; }
+
+private:
+    HANDLE      file_    = INVALID_HANDLE_VALUE;
+    HANDLE      mapping_ = nullptr;
+    const char* view_    = nullptr;
+    uint64_t    size_    = 0;
+
+    uint64_t prefetchedEnd_ = 0;
+    uint64_t prefetchCalls_ = 0;
+};
@@ -1,302 +1,1992 @@
-// rudp_receiver.cpp —— 接收端：三次握手 + SACK + 四次挥手
+// rudp_receiver.cpp —— 接收端：三次握手 + SACK + 四次挥手，一个端口上同时服务多个会话
 #include "rudp.h"
+#include "rudp_writer.h"
+#include "rudp_hash.h"
+#include "rudp_rio.h"
 
 #include <iostream>
 #include <fstream>
-#include <map>
 #include <vector>
 #include <algorithm>
 #include <cstring>
+#include <memory>
+#include <new>
+#include <chrono>
+#include <cstdio>
+#include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-// ============ 三次握手（服务端） ============
+using Clock = std::chrono::steady_clock;
 
-static bool receiverHandshake(SOCKET s, sockaddr_in& clientAddr)
+// 64 位字中最低的置位位置（调用方保证 w != 0）
+static unsigned lowestSetBit(uint64_t w)
 {
-    setRecvTimeout(s, 0); // 阻塞等待 SYN
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward64(&idx, w);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(w));
+#endif
+}
 
-    PacketHeader syn{};
-    std::vector<char> dummy;
+// 乱序重组窗口：容量固定为接收窗口大小的环，序号 seq 放在 seq % cap 号槽位，
+// 占用情况记在位图里；插入 / 按序取出都是 O(1)，生成 SACK 区间按 64 位字扫描，
+// 内存只和本会话的接收窗口有关。
+// withData 为 false 时只保留位图和长度（定位写模式：乱序分组已经直接写进文件，这里只记完成情况）
+struct ReorderWindow
+{
+    // slotBytes：每个槽位的大小，等于协商后的负载
+    ReorderWindow(size_t capacity, bool withData, size_t slotBytes)
+        : cap(capacity),
+          slotBytes(slotBytes),
+          data(withData ? capacity * slotBytes : 0),
+          lens(capacity, 0),
+          bits((capacity + 63) / 64, 0)
+    {
+    }
 
-    std::cout << "[receiver] wait for SYN...\n";
-    //循环调用 recvPacket 直到收到 SYN 报文
-    while (true)
+    bool occupied(uint32_t seq) const
     {
-        if (!recvPacket(s, syn, dummy, clientAddr))
-            continue;
+        size_t idx = seq % cap;
+        return (bits[idx / 64] >> (idx % 64)) & 1;
+    }
 
-        if (syn.flags & FLAG_SYN)
-            break;
+    void mark(uint32_t seq, uint16_t len)
+    {
+        size_t idx = seq % cap;
+        bits[idx / 64] |= uint64_t(1) << (idx % 64);
+        lens[idx] = len;
+        ++count;
     }
 
-    std::cout << "[receiver] recv SYN\n";
+    uint16_t lengthOf(uint32_t seq) const { return lens[seq % cap]; }
 
-    PacketHeader synAck{};
-    synAck.seq   = 100;            // 服务端自己的初始序号（随便选）
-    synAck.ack   = syn.seq + 1;
-    synAck.flags = FLAG_SYN | FLAG_ACK;//flag同时带有SYN和ACK
-    synAck.wnd   = static_cast<uint16_t>(g_recvWindow);
-    synAck.reserved = 0;
+    void unmark(uint32_t seq)
+    {
+        size_t idx = seq % cap;
+        bits[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+        --count;
+    }
 
-    std::cout << "[receiver] send SYN-ACK\n";
-    sendPacket(s, clientAddr, synAck, nullptr, 0);
+    void put(uint32_t seq, const char* payload, uint16_t len)
+    {
+        size_t idx = seq % cap;
+        std::memcpy(&data[idx * slotBytes], payload, len);
+        mark(seq, len);
+    }
 
-    // 等最后一个 ACK
-    int dynamicHandshakeTimeout = HANDSHAKE_TIMEOUT_MS + 2 * g_linkDelayMs;
-    setRecvTimeout(s, dynamicHandshakeTimeout);
-    
-    const int MAX_TRY = 5;
+    // 取出 seq 的负载并释放槽位（指针在该槽位被再次写入前有效）
+    const char* take(uint32_t seq, uint16_t& len)
+    {
+        size_t idx = seq % cap;
+        unmark(seq);
+        len = lens[idx];
+        return &data[idx * slotBytes];
+    }
 
-    for (int i = 0; i < MAX_TRY; ++i)
+    // 在 [from, end) 中找第一个占用状态等于 want 的序号，找不到返回 end
+    uint32_t scan(uint32_t from, uint32_t end, bool want) const
     {
-        PacketHeader last{};
-        std::vector<char> dummy2;
-        sockaddr_in from{};
-        if (!recvPacket(s, last, dummy2, from))
+        uint32_t seq = from;
+        while (seq < end)
         {
-            // 超时则重发 SYN-ACK
-            std::cout << "[receiver] wait ACK timeout, resend SYN-ACK\n";
-            sendPacket(s, clientAddr, synAck, nullptr, 0);
-            continue;
+            size_t idx = seq % cap;
+            size_t bit = idx % 64;
+            uint64_t w = want ? bits[idx / 64] : ~bits[idx / 64];
+            w >>= bit;
+
+            // 本字中还能看的位数：不越过环尾，也不越过 end
+            size_t span = std::min<size_t>(64 - bit, cap - idx);
+            span = std::min<size_t>(span, end - seq);
+            if (span < 64)
+                w &= (uint64_t(1) << span) - 1;
+            if (w != 0)
+                return seq + lowestSetBit(w);
+            seq += static_cast<uint32_t>(span);
         }
+        return end;
+    }
 
-        if ((last.flags & FLAG_ACK) && last.ack == synAck.seq + 1)
+    // 从 expectedSeq 开始把已缓存的连续序号合并成区间，最多 maxBlocks 个
+    size_t collectSack(uint32_t expectedSeq, SackBlock* out, size_t maxBlocks) const
+    {
+        // expectedSeq 之后最多只可能缓存到 expectedSeq + cap - 1
+        const uint32_t end = expectedSeq + static_cast<uint32_t>(cap);
+        size_t n = 0;
+        uint32_t seq = expectedSeq;
+        while (n < maxBlocks && count > 0)
         {
-            std::cout << "[receiver] handshake success\n";
-            setRecvTimeout(s, 0); // 数据阶段改回阻塞
-            return true;
+            uint32_t start = scan(seq, end, true);
+            if (start == end)
+                break;
+            uint32_t stop = scan(start, end, false);
+            out[n++] = SackBlock{start, stop - 1};
+            seq = stop;
         }
+        return n;
     }
 
-    std::cerr << "[receiver] handshake failed\n";
-    return false;
-}
+    // 位图 SACK：把 [expectedSeq, expectedSeq + maxBits) 的接收情况写进 out，
+    // 返回有效位数（截到最后一个已缓存的分组），只写有效位数覆盖到的字节
+    size_t collectBitmap(uint32_t expectedSeq, uint8_t* out, size_t maxBits) const
+    {
+        const uint32_t end = expectedSeq + static_cast<uint32_t>(std::min(cap, maxBits));
+        size_t nbits = 0;
+        uint32_t seq = expectedSeq;
+        while (count > 0)
+        {
+            uint32_t start = scan(seq, end, true);
+            if (start == end)
+                break;
+            uint32_t stop = scan(start, end, false);
+            size_t bytes = (stop - expectedSeq + 7) / 8;
+            std::memset(out + (nbits + 7) / 8, 0, bytes - (nbits + 7) / 8);
+            for (size_t i = start - expectedSeq; i < stop - expectedSeq; ++i)
+                out[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+            nbits = stop - expectedSeq;
+            seq = stop;
+        }
+        return nbits;
+    }
 
-// 构造 ACK + SACK payload 并发送
-//buffer是一个有序的map(seq,data)，存的是已经收到了，但还没有按序写入文件的乱序分组
-//cumulativeAck是已经按序收到并写入文件的最大序号
-static void sendAckWithSack(
-    SOCKET s,
-    const sockaddr_in& clientAddr,
-    uint32_t cumulativeAck,
-    const std::map<uint32_t, std::vector<char>>& buffer)
+    size_t                cap;
+    size_t                slotBytes;
+    std::vector<char>     data;    // cap 个 slotBytes 大小的槽位首尾相接
+    std::vector<uint16_t> lens;    // 每个槽位的负载长度
+    std::vector<uint64_t> bits;    // 占用位图
+    size_t                count = 0;
+};
+
+// 前向纠错还原：每组一个累加器，组内首次到达的 DATA 负载和校验分组负载都异或进去，
+// 组内只差一个分组且校验分组已到时，累加结果就是缺失分组的负载。
+// 累加器按组号循环复用，个数覆盖接收窗口内可能同时出现的所有组
+struct FecDecoder
 {
-    // 根据 buffer 里的乱序分组构造多个区间
-    std::vector<SackBlock> blocks;
-    uint32_t lastStart = 0, lastEnd = 0;
-    bool hasRange = false;
-    //在buffer中按照序号，从小到大把连续的序号合并成区间
-    for (const auto& kv : buffer)
+    struct Group
     {
-        uint32_t seq = kv.first;
-        if (seq <= cumulativeAck)
-            continue;
+        uint32_t id       = UINT32_MAX;   // 组号 (seq - 1) / groupSize
+        uint64_t received = 0;            // 已累加的 DATA 分组（按组内位置置位）
+        uint8_t  total    = 0;            // 组内分组数，校验分组到达之前为 0
+        uint16_t lenXor   = 0;            // 已累加负载长度（含校验分组的 wnd）的异或
+        bool     done     = false;        // 已还原或已收齐
+    };
 
-        if (!hasRange)
+    struct Recovered
+    {
+        uint32_t seq;
+        size_t   slot;
+        uint16_t len;
+    };
+
+    FecDecoder(size_t windowPackets, size_t slotBytes)
+        : windowPackets(windowPackets), slotBytes(slotBytes)
+    {
+    }
+
+    // 组大小取第一个带 reserved 的 DATA 分组给出的值，之后按它分配累加器
+    bool ready(uint8_t size)
+    {
+        if (groupSize == 0)
         {
-            lastStart = lastEnd = seq;
-            hasRange  = true;
+            if (size < 2 || size > MAX_FEC_GROUP)
+                return false;
+            groupSize = size;
+            groups.resize(windowPackets / size + 2);
+            acc.assign(groups.size() * slotBytes, 0);
         }
-        else if (seq == lastEnd + 1)
+        return size == groupSize;
+    }
+
+    // DATA 分组首次到达（重复分组不要再加）
+    void addData(uint32_t seq, uint8_t size, const char* payload, uint16_t len)
+    {
+        if (!ready(size))
+            return;
+        size_t idx = slotFor((seq - 1) / groupSize);
+        Group& g = groups[idx];
+        xorBytes(&acc[idx * slotBytes], payload, len);
+        g.received |= uint64_t(1) << ((seq - 1) % groupSize);
+        g.lenXor   ^= len;
+        check(idx);
+    }
+
+    // 校验分组到达：组大小还不知道（本组之前的 DATA 全丢了）时无法使用
+    void addParity(const PacketHeader& hdr, const char* payload, uint16_t len)
+    {
+        if (groupSize == 0 || hdr.seq == 0 || (hdr.seq - 1) % groupSize != 0 ||
+            hdr.reserved == 0 || hdr.reserved > groupSize || len > slotBytes)
+            return;
+        size_t idx = slotFor((hdr.seq - 1) / groupSize);
+        Group& g = groups[idx];
+        if (g.total != 0)
+            return;
+        xorBytes(&acc[idx * slotBytes], payload, len);
+        g.total   = hdr.reserved;
+        g.lenXor ^= hdr.wnd;
+        check(idx);
+    }
+
+    // 取出一个已还原的分组（负载在对应累加器被复用前有效）
+    bool takeRecovered(uint32_t& seq, const char*& payload, uint16_t& len)
+    {
+        if (ready_.empty())
+            return false;
+        Recovered r = ready_.back();
+        ready_.pop_back();
+        seq     = r.seq;
+        payload = &acc[r.slot * slotBytes];
+        len     = r.len;
+        return true;
+    }
+
+    size_t slotFor(uint32_t id)
+    {
+        size_t idx = id % groups.size();
+        Group& g = groups[idx];
+        if (g.id != id)
         {
-            lastEnd = seq;
+            g    = Group{};
+            g.id = id;
+            std::memset(&acc[idx * slotBytes], 0, slotBytes);
         }
-        //把之前的乱序区间作为一个SackBlock放入blocks，开始新的区间
-        else
+        return idx;
+    }
+
+    void check(size_t idx)
+    {
+        Group& g = groups[idx];
+        if (g.done || g.total == 0)
+            return;
+        uint64_t all = (g.total == 64) ? ~uint64_t(0) : (uint64_t(1) << g.total) - 1;
+        uint64_t missing = all & ~g.received;
+        if (missing != 0 && (missing & (missing - 1)) != 0)
+            return;   // 还缺两个以上，等重传或后续分组
+        g.done = true;
+        if (missing == 0 || g.lenXor > slotBytes)
+            return;
+        g.received |= missing;
+        ready_.push_back(Recovered{g.id * groupSize + 1 + lowestSetBit(missing),
+                                   idx, g.lenXor});
+    }
+
+    size_t                 windowPackets;
+    size_t                 slotBytes;
+    uint8_t                groupSize = 0;
+    std::vector<Group>     groups;
+    std::vector<char>      acc;      // 每组一个 slotBytes 大小的累加器
+    std::vector<Recovered> ready_;
+};
+
+// ============ 握手选项协商 ============
+
+inline constexpr uint32_t RECEIVER_SYN_SEQ = 100;   // 服务端自己的初始序号（随便选）
+inline constexpr uint32_t RECEIVER_FIN_SEQ = 2;     // 服务端 FIN 的序号
+inline constexpr int      RECEIVER_MAX_TRY = 5;     // SYN-ACK / FIN 最多发送次数
+inline constexpr int      RECV_STOP_POLL_MS = 100;  // recv 模式检查 g_stopReceiver 的最长间隔
+
+// 每个会话接收侧缓冲的总字节预算（对应发送端的 SEND_RING_BYTES_MAX）：
+// 写盘队列 + 乱序重组环 + 前向纠错累加器。会话在 SYN 到达时就按协商负载分配这些缓冲，
+// 大负载时按字节收小本会话的接收窗口，监听端的内存不随负载大小成倍放大
+inline constexpr size_t RECV_SESSION_BYTES_MAX = 64u << 20;
+
+// 本端接受的最大负载（--payload，默认最大数据报）
+static int receiverPayloadLimit()
+{
+    return g_payloadSize > 0 ? g_payloadSize : MAX_NEGOTIATED_PAYLOAD;
+}
+
+// 本会话的接收窗口：g_recvWindow，但按窗口分配的缓冲不超过 RECV_SESSION_BYTES_MAX。
+// 每个窗口槽位占重组环一个负载（定位写时不缓存数据）和前向纠错累加器最多半个负载（组大小至少 2）
+static uint16_t sessionWindow(uint16_t payloadSize, bool directWrite)
+{
+    const size_t budget    = RECV_SESSION_BYTES_MAX - (directWrite ? 0 : WRITE_QUEUE_BYTES);
+    const size_t perPacket = (directWrite ? 0 : payloadSize) + payloadSize / 2 + 1;
+    return static_cast<uint16_t>(std::max<size_t>(
+        1, std::min<size_t>(static_cast<size_t>(g_recvWindow), budget / perPacket)));
+}
+
+//根据 SYN 决定本连接启用的握手选项：接收端支持的选项都同意，把对端请求中认识的部分原样带回
+//payloadSize 带回协商出的 DATA 负载大小（对端没有请求时为 MAX_PAYLOAD）
+//stream 带回多流传输的流描述（返回值带 OPT_STREAM 时有效）
+//window 带回本会话的接收窗口（按协商负载收在接收缓冲预算之内），SYN-ACK 和之后的 ACK 都通告它
+static uint8_t negotiateOptions(const PacketHeader& syn, const char* payload, uint16_t len,
+                                uint16_t& payloadSize, StreamDescriptor& stream,
+                                uint16_t& window)
+{
+    uint8_t options = syn.reserved &
+                      (OPT_CRC32C | OPT_SACK_BITMAP | OPT_PAYLOAD_SIZE | OPT_STREAM);
+
+    // 负载大小：取对端请求与本端上限中较小的一个
+    payloadSize = MAX_PAYLOAD;
+    uint16_t requested = 0;
+    if ((options & OPT_PAYLOAD_SIZE) && len >= sizeof(requested))
+    {
+        std::memcpy(&requested, payload, sizeof(requested));
+        payloadSize = static_cast<uint16_t>(
+            std::max<int>(64, std::min<int>(requested, receiverPayloadLimit())));
+    }
+    else
+    {
+        options &= ~OPT_PAYLOAD_SIZE;
+    }
+
+    // 流描述跟在请求负载大小之后（对端请求了负载大小才有这 2 字节）
+    const size_t streamAt = (syn.reserved & OPT_PAYLOAD_SIZE) ? sizeof(uint16_t) : 0;
+    bool streamOk = false;
+    if ((options & OPT_STREAM) && len >= streamAt + sizeof(StreamDescriptor))
+    {
+        std::memcpy(&stream, payload + streamAt, sizeof(StreamDescriptor));
+        streamOk = stream.count >= 1 && stream.count <= MAX_STREAMS &&
+                   stream.index < stream.count && stream.offset <= stream.fileSize &&
+                   stream.length <= stream.fileSize - stream.offset;
+    }
+    if (!streamOk)
+        options &= ~OPT_STREAM;
+
+    window = sessionWindow(payloadSize, g_directWrite || (options & OPT_STREAM));
+    return options;
+}
+
+// ============ 多流传输的共享输出文件 ============
+
+// 同一发送端（同一 IP）同一传输号的各个流写进同一个输出文件：第一个流到达时打开文件，
+// 按文件总长一次预分配并设好长度，各流按自己的字节范围定位写；
+// 所有流结束后从登记表中删除，文件随最后一个引用关闭。
+// 登记表只在会话建立 / 结束时加锁，不同工作线程上的流可以共用一个文件
+struct StripedOutput
+{
+    PositionalFile file;
+    uint32_t       addr          = 0;
+    uint32_t       transferId    = 0;
+    uint16_t       count         = 0;
+    uint64_t       fileSize      = 0;
+    uint16_t       streamsDone   = 0;   // 以下由 g_stripeMutex 保护
+    uint16_t       streamsFailed = 0;
+    uint64_t       bytesWritten  = 0;
+    Clock::time_point firstOpened;
+};
+
+static std::mutex g_stripeMutex;
+static std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<StripedOutput>> g_stripes;
+
+// 找到（或第一次时打开并预分配）某个传输的输出文件；描述和已登记的不一致时返回空
+static std::shared_ptr<StripedOutput> acquireStripe(uint32_t addr, const StreamDescriptor& desc,
+                                                    const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(g_stripeMutex);
+    std::shared_ptr<StripedOutput>& entry = g_stripes[{addr, desc.transferId}];
+    if (!entry)
+    {
+        auto out = std::make_shared<StripedOutput>();
+        if (!out->file.open(path) || !out->file.preallocate(desc.fileSize))
         {
-            blocks.push_back(SackBlock{lastStart, lastEnd});
-            if (blocks.size() >= MAX_SACK_BLOCKS)
-                break;
-            lastStart = lastEnd = seq;
+            g_stripes.erase({addr, desc.transferId});
+            return nullptr;
         }
+        out->addr        = addr;
+        out->transferId  = desc.transferId;
+        out->count       = desc.count;
+        out->fileSize    = desc.fileSize;
+        out->firstOpened = Clock::now();
+        entry = out;
     }
-    if (hasRange && blocks.size() < MAX_SACK_BLOCKS)
+    if (entry->count != desc.count || entry->fileSize != desc.fileSize)
+        return nullptr;
+    return entry;
+}
+
+// 一个流结束：返回 true 表示这是该传输的最后一个流，此时输出整个传输的汇总
+static bool releaseStripe(StripedOutput& out, bool failed, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(g_stripeMutex);
+    ++out.streamsDone;
+    if (failed)
+        ++out.streamsFailed;
+    out.bytesWritten += bytes;
+    if (out.streamsDone < out.count)
+        return false;
+    g_stripes.erase({out.addr, out.transferId});
+    return true;
+}
+
+// 构造 ACK + SACK payload 并发送
+//window里存的是已经收到了，但还没有按序写入文件的乱序分组
+//cumulativeAck是已经按序收到并写入文件的最大序号
+//wnd是调用方算好的通告窗口，integrityFlag是协商出的校验方式标志
+//bitmapSack为true时负载用位图描述整个窗口，否则最多带MAX_SACK_BLOCKS个区间
+static void sendAckWithSack(
+    SOCKET s,
+    const sockaddr_in& clientAddr,
+    uint32_t cumulativeAck,
+    const ReorderWindow& window,
+    uint16_t wnd,
+    uint8_t integrityFlag,
+    bool bitmapSack)
+{
+    PacketHeader ackHdr{};
+    ackHdr.seq   = 0;
+    ackHdr.ack   = cumulativeAck;
+    ackHdr.flags = FLAG_ACK | integrityFlag;
+    ackHdr.wnd   = wnd;
+    ackHdr.reserved = 0;
+
+    if (bitmapSack)
     {
-        blocks.push_back(SackBlock{lastStart, lastEnd});
+        // payload 格式：[uint16_t bitCount][位图]，第 i 位对应 cumulativeAck + 1 + i
+        char payload[sizeof(uint16_t) + MAX_SACK_BITMAP_BYTES];
+        uint16_t bitCount = static_cast<uint16_t>(window.collectBitmap(
+            cumulativeAck + 1,
+            reinterpret_cast<uint8_t*>(payload + sizeof(uint16_t)),
+            MAX_SACK_BITMAP_BITS));
+        std::memcpy(payload, &bitCount, sizeof(uint16_t));
+
+        ackHdr.flags |= FLAG_SACK_BITMAP;
+        sendPacket(s, clientAddr, ackHdr, payload,
+                   static_cast<uint16_t>(sizeof(uint16_t) + (bitCount + 7) / 8));
+        return;
     }
 
-    uint16_t blkCount = static_cast<uint16_t>(blocks.size());
+    // 根据重组窗口的位图，从小到大把连续的序号合并成区间
+    SackBlock blocks[MAX_SACK_BLOCKS];
+    uint16_t blkCount = static_cast<uint16_t>(
+        window.collectSack(cumulativeAck + 1, blocks, MAX_SACK_BLOCKS));
 
     // payload 格式：
     // [uint16_t blkCount][SackBlock blk1][SackBlock blk2]...
-    std::vector<char> payload;
-    payload.resize(sizeof(uint16_t) + blkCount * sizeof(SackBlock));
-    std::memcpy(payload.data(), &blkCount, sizeof(uint16_t));
+    char payload[sizeof(uint16_t) + MAX_SACK_BLOCKS * sizeof(SackBlock)];
+    std::memcpy(payload, &blkCount, sizeof(uint16_t));
     size_t offset = sizeof(uint16_t);
-    for (size_t i = 0; i < blocks.size(); ++i)
+    for (uint16_t i = 0; i < blkCount; ++i)
     {
-        std::memcpy(payload.data() + offset,
-                    &blocks[i], sizeof(SackBlock));
+        std::memcpy(payload + offset, &blocks[i], sizeof(SackBlock));
         offset += sizeof(SackBlock);
     }
 
-    PacketHeader ackHdr{};
-    ackHdr.seq   = 0;
-    ackHdr.ack   = cumulativeAck;
-    ackHdr.flags = FLAG_ACK;
-    // 简单流量控制：窗口 = g_recvWindow - 当前缓存的分组数
-    // 已经缓存的乱序分组数量buffer.size()，可用窗口就是 g_recvWindow 减去这个数量
-    uint16_t avail = static_cast<uint16_t>(
-        std::max<int>(1, g_recvWindow -
-                         static_cast<int>(buffer.size())));
-    ackHdr.wnd   = avail;
-    ackHdr.reserved = 0;
-
     sendPacket(s, clientAddr,
                ackHdr,
-               payload.data(),
-               static_cast<uint16_t>(payload.size()));
+               payload,
+               static_cast<uint16_t>(offset));
 }
 
-// ============ 接收端主逻辑 ============
+// ============ 接收会话 ============
 
-void runReceiver(uint16_t port, const std::string& outputFile)
+// 一个会话对应一个 (对端地址, 连接号)：握手 / 挥手状态、重组窗口、前向纠错、
+// ACK 合并、写盘和文件摘要都归它自己。会话不自己收包，由监听循环按分组头部分派进来；
+// 原来阻塞等待的地方（等最后一个 ACK、延迟 ACK、等挥手 ACK）都变成截止时刻，由监听循环统一睡眠
+class ReceiverSession
 {
-    //创建UDP套接字并绑定端口
-    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (s == INVALID_SOCKET)
+public:
+    //options / payloadSize / window：按 SYN 协商出的握手选项、负载大小和本会话的接收窗口
+    //label：日志和统计中的会话名，空串表示单会话的 recv 模式
+    //stream：多流传输中的一个流时为它的流描述，否则为空；流总是定位写到共享文件中自己的范围
+    ReceiverSession(SOCKET s, const sockaddr_in& peer, uint32_t connId,
+                    uint8_t options, uint16_t payloadSize, uint16_t window,
+                    const std::string& label, const StreamDescriptor* stream);
+    ReceiverSession(const ReceiverSession&) = delete;
+    ReceiverSession& operator=(const ReceiverSession&) = delete;
+
+    // 打开输出文件并准备写盘，失败时不应再使用这个会话
+    bool openOutput(const std::string& outputFile);
+    // 多流传输：写进各流共享的输出文件
+    void attachStripe(std::shared_ptr<StripedOutput> stripe);
+
+    // 监听循环把属于本会话的分组（包括 SYN 及其重传）交进来
+    void onPacket(const PacketHeader& hdr, const char* data, uint16_t len,
+                  Clock::time_point now);
+
+    // 到了 nextDeadline() 时由监听循环调用：延迟 ACK、SYN-ACK / FIN 重发、空闲超时
+    void onTimer(Clock::time_point now);
+    Clock::time_point nextDeadline() const;
+
+    bool   closed() const { return state_ == State::Closed; }
+    bool   established() const { return established_; }
+    bool   failed() const { return failed_; }
+    size_t packetBytes() const { return sizeof(ExtPacketHeader) + negotiatedPayload_; }
+    uint16_t recvWindow() const { return recvWindow_; }
+    uint64_t bytesWritten() const { return bytesWritten_; }
+    StripedOutput* stripe() const { return stripe_.get(); }
+    void   printStats() const;
+
+private:
+    enum class State
     {
-        printLastError("socket");
-        return;
-    }
+        SynReceived,   // 已回 SYN-ACK，等最后一个 ACK
+        Established,   // 数据阶段
+        LastAck,       // 已回 ACK + FIN，等发送端最后一个 ACK
+        Closed
+    };
 
-    sockaddr_in local{};
-    local.sin_family      = AF_INET;
-    local.sin_addr.s_addr = INADDR_ANY;
-    local.sin_port        = htons(port);
-    //绑定端口
-    if (bind(s, reinterpret_cast<sockaddr*>(&local),
-             sizeof(local)) == SOCKET_ERROR)
+    void establish();
+    void sendSynAck(Clock::time_point now);
+    void sendFinReply(Clock::time_point now);
+    void finishOutput();
+    void abortSession(const char* why);
+
+    void onData(const PacketHeader& hdr, const char* data, uint16_t len, Clock::time_point now);
+    void onProbe(const PacketHeader& hdr, const char* data, uint16_t len);
+    bool dataFits(uint32_t seq, uint16_t len);
+    void onParity(const PacketHeader& hdr, const char* data, uint16_t len);
+    void onFin(const PacketHeader& hdr, const char* data, uint16_t len, Clock::time_point now);
+
+    void deliver(uint32_t seq, const char* buf, uint16_t bufLen);
+    void hashInOrder(const char* buf, uint16_t bufLen);
+    bool acceptData(uint32_t seq, const char* payload, uint16_t payloadLen, uint8_t fecGroupSize);
+    bool recoverFromFec();
+    uint16_t advertisedWindow() const;
+    void flushAck();
+
+    SOCKET         s_;
+    sockaddr_in    peer_;
+    uint32_t       connId_;
+    std::string    label_;
+    std::string    tag_;            // 日志前缀
+    const uint8_t  options_;
+    // 握手协商的负载大小决定各缓冲区的大小；路径 MTU 探测收小后发送端在第一个 DATA
+    // 之前通知实际使用的大小，定位写偏移按 payloadSize_ 计算
+    const uint16_t negotiatedPayload_;
+    uint16_t       payloadSize_;
+    const uint16_t recvWindow_;     // 本会话的接收窗口：g_recvWindow 按接收缓冲预算收小后的值
+    const uint8_t  integrityFlag_;  // 协商了 CRC32C 时回给发送端的分组也带 CRC32C 扩展头部
+    const bool     bitmapSack_;     // 协商了位图 SACK 时 ACK 描述整个窗口的接收情况
+    const bool     directWrite_;    // 定位写：--direct-write 或多流传输
+    const uint64_t baseOffset_;     // 本会话数据在输出文件中的起点（多流传输时为流的范围起点）
+
+    State             state_       = State::SynReceived;
+    bool              established_ = false;
+    bool              failed_      = false;
+    int               retries_     = 0;   // 当前阶段已经超时的次数
+    Clock::time_point retransmitAt_;      // SYN-ACK / FIN 的重发时刻
+    Clock::time_point lastHeard_;         // 最近一次收到本会话分组的时刻
+
+    // 两种落盘方式：
+    //   默认：按序数据交给写线程落盘，收包循环不会被磁盘卡住
+    //   --direct-write：每个分组直接写到文件中的固定偏移，乱序分组不占内存
+    //                   （多流传输时是各流共享的文件，stripe_ 持有它）
+    std::ofstream                   fout_;
+    std::unique_ptr<DiskWriter>     writer_;
+    std::shared_ptr<PositionalFile> directFile_;
+    std::shared_ptr<StripedOutput>  stripe_;
+    bool                        directWriteFailed_ = false;
+    bool                        writeOk_           = true;
+    uint64_t                    bytesWritten_      = 0;
+
+    // 端到端文件摘要：按序交付的数据依次喂给 XXH64，FIN 时和发送端的摘要核对
+    Xxh64             fileHash_;
+    uint64_t          hashNs_          = 0;
+    std::vector<char> readBack_;
+    uint64_t          readBackPackets_ = 0;
+    uint64_t          fileDigest_      = 0;
+
+    uint32_t expectedSeq_ = 1;   // 期望的下一个有序分组号
+    // 乱序缓存：发送端在途分组不超过通告窗口，缓存的序号一定落在
+    // [expectedSeq, expectedSeq + recvWindow_) 之内，用同样大小的环即可
+    ReorderWindow window_;
+    FecDecoder    fec_;
+
+    // ACK 合并：按序到达的分组每 g_ackEvery 个回一个 ACK，不足时最多等 g_ackDelayMs；
+    // 乱序、重复、补上空洞以及还有乱序分组缓存时立即回 ACK，保证发送端及时发现丢包
+    uint32_t          pendingAcks_ = 0;   // 已收到但还没确认的数据分组数
+    Clock::time_point ackDeadline_;       // 第一个未确认分组的最晚确认时刻
+
+    uint32_t finSeq_        = 0;       // 对方 FIN 的序号，用于 ACK 确认
+    uint64_t peerDigest_    = 0;       // 发送端 FIN 中带来的文件摘要
+    bool     peerHasDigest_ = false;
+
+    uint64_t packets_        = 0;   // 分派到本会话的分组数
+    uint64_t dataPackets_    = 0;   // 收到的 DATA 分组数
+    uint64_t acksSent_       = 0;
+    uint64_t acksImmediate_  = 0;   // 乱序 / 空洞触发的立即 ACK
+    uint64_t acksByCount_    = 0;   // 累计满 g_ackEvery 个分组的 ACK
+    uint64_t acksByTimer_    = 0;   // 延迟定时器到期的 ACK
+    uint64_t parityReceived_ = 0;   // 收到的校验分组数
+    uint64_t fecRecovered_   = 0;   // 用校验分组还原的分组数
+    uint64_t probesAnswered_ = 0;   // 回应过的路径 MTU 探测分组数
+    uint64_t dataRejected_   = 0;   // 长度与负载大小不符而丢弃的 DATA 分组数
+
+    // 定位写时短于 payloadSize_ 的 DATA 只能是最后一个分组
+    uint32_t highestSeq_ = 0;            // 收到过的最大 DATA 序号
+    uint32_t tailSeq_    = UINT32_MAX;   // 短分组（最后一个分组）的序号
+};
+
+
+ReceiverSession::ReceiverSession(SOCKET s, const sockaddr_in& peer, uint32_t connId,
+                                 uint8_t options, uint16_t payloadSize, uint16_t window,
+                                 const std::string& label, const StreamDescriptor* stream)
+    : s_(s),
+      peer_(peer),
+      connId_(connId),
+      label_(label),
+      tag_(label.empty() ? "[receiver]" : "[receiver " + label + "]"),
+      options_(options),
+      negotiatedPayload_(payloadSize),
+      payloadSize_(payloadSize),
+      recvWindow_(window),
+      integrityFlag_((options & OPT_CRC32C) ? FLAG_CRC32C : 0),
+      bitmapSack_((options & OPT_SACK_BITMAP) != 0),
+      directWrite_(g_directWrite || stream != nullptr),
+      baseOffset_(stream ? stream->offset : 0),
+      readBack_(directWrite_ ? payloadSize : 0),
+      window_(recvWindow_, !directWrite_, payloadSize),
+      fec_(window_.cap, payloadSize)
+{
+}
+
+
+bool ReceiverSession::openOutput(const std::string& outputFile)
+{
+    if (directWrite_)
+        directFile_ = std::make_shared<PositionalFile>();
+    bool openOk = directWrite_ ? directFile_->open(outputFile)
+                               : (fout_.open(outputFile, std::ios::binary), fout_.is_open());
+    if (!openOk)
     {
-        printLastError("bind");
-        closesocket(s);
-        return;
+        std::cerr << tag_ << " open output file failed: " << outputFile << "\n";
+        return false;
     }
-    //三次握手，确认对端地址
-    sockaddr_in clientAddr{};
-    if (!receiverHandshake(s, clientAddr))
+    if (!directWrite_)
+        writer_ = std::make_unique<DiskWriter>(fout_, payloadSize_);
+    return true;
+}
+
+
+void ReceiverSession::attachStripe(std::shared_ptr<StripedOutput> stripe)
+{
+    stripe_     = std::move(stripe);
+    directFile_ = std::shared_ptr<PositionalFile>(stripe_, &stripe_->file);
+}
+
+
+void ReceiverSession::onPacket(const PacketHeader& hdr, const char* data, uint16_t len,
+                               Clock::time_point now)
+{
+    lastHeard_ = now;
+    ++packets_;
+
+    if (hdr.flags & FLAG_SYN)
     {
-        closesocket(s);
+        // 第一个 SYN，或 SYN-ACK 丢了发送端重发的 SYN：（再）回一个 SYN-ACK
+        if (state_ == State::SynReceived)
+            sendSynAck(now);
         return;
     }
 
-    std::ofstream fout(outputFile, std::ios::binary);
-    if (!fout)
+    if (state_ == State::SynReceived)
     {
-        std::cerr << "[receiver] open output file failed\n";
-        closesocket(s);
-        return;
+        if ((hdr.flags & FLAG_ACK) && hdr.ack == RECEIVER_SYN_SEQ + 1)
+        {
+            establish();
+            return;
+        }
+        // 最后一个 ACK 丢了：发送端收到 SYN-ACK 才会往下走，它后续的分组同样说明握手已完成
+        if (!(hdr.flags & (FLAG_DATA | FLAG_FEC | FLAG_PROBE | FLAG_FIN)))
+            return;
+        establish();
     }
 
-    uint32_t expectedSeq = 1; // 期望的下一个有序分组号
-    std::map<uint32_t, std::vector<char>> buffer; // 用一个有序map做乱序缓存
-    //key表示分组的序号，value表示这个分组的payload数据
-
-    bool finReceived = false;//标记是否已经收到了对方的FIN
-    uint32_t finSeq  = 0;//记录对方的FIN包的序号，用于后续的ACK确认
-
-    //没收到FIN就一直循环
-    while (!finReceived)
+    if (state_ == State::Established)
     {
-        PacketHeader hdr{};
-        std::vector<char> data;
-        sockaddr_in from{};
-
-        if (!recvPacket(s, hdr, data, from))
-            continue;
         //处理数据报文
         if (hdr.flags & FLAG_DATA)
+            onData(hdr, data, len, now);
+        else if (hdr.flags & FLAG_PROBE)
+            onProbe(hdr, data, len);
+        else if (hdr.flags & FLAG_FEC)
+            onParity(hdr, data, len);
+        else if (hdr.flags & FLAG_FIN)
+            onFin(hdr, data, len, now);
+    }
+    else if (state_ == State::LastAck)
+    {
+        if (hdr.flags & FLAG_FIN)
         {
-            // 收到数据分组
-            if (hdr.seq >= expectedSeq)
-            {
-                // 只缓存之前没收到的 seq
-                //收到乱序数据先放在map里，等缺失的前面分组到了一起写
-                if (buffer.find(hdr.seq) == buffer.end())
-                {
-                    buffer[hdr.seq] = data;
-                }
+            // 发送端没收到 ACK 又重发了 FIN：ACK 和自己的 FIN 都再回一次
+            sendFinReply(now);
+        }
+        else if ((hdr.flags & FLAG_ACK) && hdr.ack == RECEIVER_FIN_SEQ + 1)
+        {
+            std::cout << tag_ << " four-way close done\n";
+            state_ = State::Closed;
+        }
+    }
+}
 
-                // 把连续有序的分组写入文件
-                while (true)
-                {
-                    auto it = buffer.find(expectedSeq);
-                    if (it == buffer.end())
-                        break;
-                    //从map中取出对应序号的分组数据写入文件
-                    fout.write(it->second.data(),
-                               static_cast<std::streamsize>(
-                                   it->second.size()));
-                    buffer.erase(it);//从buffer中删除该分组
-                    ++expectedSeq;
-                }
-                //这样就实现了一旦前边的窗口补齐，就可以把后面已经缓存好的连续段一次写出来
-            }
-            //累计确认号，已经成功按序收到并写入文件的最大序号
-            uint32_t cumulativeAck = expectedSeq - 1;
-            //payload中带SACK信息，把buffer中所有比cumulativeAck大的分组区间都带上
-            sendAckWithSack(s, clientAddr, cumulativeAck, buffer);
+
+void ReceiverSession::onTimer(Clock::time_point now)
+{
+    switch (state_)
+    {
+    case State::SynReceived:
+        if (now < retransmitAt_)
+            break;
+        if (++retries_ >= RECEIVER_MAX_TRY)
+        {
+            std::cerr << tag_ << " handshake failed\n";
+            state_  = State::Closed;
+            failed_ = true;
+            break;
         }
-        else if (hdr.flags & FLAG_FIN)
+        // 超时则重发 SYN-ACK
+        std::cout << tag_ << " wait ACK timeout, resend SYN-ACK\n";
+        sendSynAck(now);
+        break;
+
+    case State::Established:
+        if (pendingAcks_ > 0 && now >= ackDeadline_)
+        {
+            flushAck();
+            ++acksByTimer_;
+        }
+        if (now - lastHeard_ >= std::chrono::milliseconds(SESSION_IDLE_TIMEOUT_MS))
+            abortSession("peer silent, abort session");
+        break;
+
+    case State::LastAck:
+        if (now < retransmitAt_)
+            break;
+        std::cout << tag_ << " wait last ACK timeout\n";
+        if (++retries_ >= RECEIVER_MAX_TRY)
         {
-            std::cout << "[receiver] recv FIN\n";
-            finReceived = true;//退出循环
-            finSeq      = hdr.seq;
+            state_ = State::Closed;
+            break;
         }
+        sendFinReply(now);
+        break;
+
+    case State::Closed:
+        break;
+    }
+}
+
+
+Clock::time_point ReceiverSession::nextDeadline() const
+{
+    switch (state_)
+    {
+    case State::SynReceived:
+    case State::LastAck:
+        return retransmitAt_;
+    case State::Established:
+    {
+        // 有待确认的分组时只睡到延迟 ACK 的截止时刻
+        Clock::time_point idle =
+            lastHeard_ + std::chrono::milliseconds(SESSION_IDLE_TIMEOUT_MS);
+        return pendingAcks_ > 0 ? std::min(idle, ackDeadline_) : idle;
     }
+    case State::Closed:
+        break;
+    }
+    return Clock::time_point::max();
+}
+
+
+void ReceiverSession::establish()
+{
+    std::cout << tag_ << " handshake success\n";
+    state_       = State::Established;
+    established_ = true;
+}
+
+
+void ReceiverSession::sendSynAck(Clock::time_point now)
+{
+    PacketHeader synAck{};
+    synAck.seq   = RECEIVER_SYN_SEQ;
+    synAck.ack   = connId_ + 1;
+    synAck.flags = FLAG_SYN | FLAG_ACK;//flag同时带有SYN和ACK
+    synAck.wnd   = recvWindow_;
+    synAck.reserved = options_;
+    // 协商了负载大小时 SYN-ACK 负载是接收端同意的大小
+    const char*    payload = (options_ & OPT_PAYLOAD_SIZE)
+                                 ? reinterpret_cast<const char*>(&payloadSize_)
+                                 : nullptr;
+    const uint16_t len     = payload ? sizeof(payloadSize_) : 0;
 
-    fout.close();
+    std::cout << tag_ << " send SYN-ACK\n";
+    sendPacket(s_, peer_, synAck, payload, len);
+    int dynamicHandshakeTimeout = HANDSHAKE_TIMEOUT_MS + 2 * g_linkDelayMs;
+    retransmitAt_ = now + std::chrono::milliseconds(dynamicHandshakeTimeout);
+}
 
-    // ===== 四次挥手（服务端被动关闭） =====
-    // 已经完成：
-    //   (1) 客户端 ---> FIN
-    // 现在要完成：
-    //   (2) 服务端 ---> ACK
-    //   (3) 服务端 ---> FIN
-    //   (4) 客户端 ---> ACK
 
+// ===== 四次挥手（服务端被动关闭） =====
+//   (1) 客户端 ---> FIN         onFin
+//   (2) 服务端 ---> ACK         sendFinReply
+//   (3) 服务端 ---> FIN         sendFinReply，超时重发
+//   (4) 客户端 ---> ACK         onPacket（LastAck 状态）
+void ReceiverSession::sendFinReply(Clock::time_point now)
+{
     // (2) ACK 客户端 FIN
     PacketHeader ack1{};
     ack1.seq   = 0;
-    ack1.ack   = finSeq + 1;
-    ack1.flags = FLAG_ACK;
-    ack1.wnd   = static_cast<uint16_t>(g_recvWindow);
+    ack1.ack   = finSeq_ + 1;
+    ack1.flags = FLAG_ACK | integrityFlag_;
+    ack1.wnd   = recvWindow_;
     ack1.reserved = 0;
 
-    sendPacket(s, clientAddr, ack1, nullptr, 0);
-    std::cout << "[receiver] send ACK of FIN\n";
+    sendPacket(s_, peer_, ack1, nullptr, 0);
+    std::cout << tag_ << " send ACK of FIN\n";
 
-    // (3) 发送自己的 FIN
+    // (3) 发送自己的 FIN，把自己算出的摘要带回去，发送端据此报告传输结果
     PacketHeader fin2{};
-    fin2.seq   = 2;
+    fin2.seq   = RECEIVER_FIN_SEQ;
     fin2.ack   = 0;
-    fin2.flags = FLAG_FIN;
+    fin2.flags = FLAG_FIN | integrityFlag_;
     fin2.wnd   = 0;
     fin2.reserved = 0;
 
-    setRecvTimeout(s, HANDSHAKE_TIMEOUT_MS);
-    const int MAX_TRY = 5;
+    std::cout << tag_ << " send FIN\n";
+    sendPacket(s_, peer_, fin2,
+               reinterpret_cast<const char*>(&fileDigest_), FIN_DIGEST_BYTES);
+    retransmitAt_ = now + std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS);
+}
+
 
-    for (int i = 0; i < MAX_TRY; ++i)
+// 等写线程把队列里剩下的数据写完，关闭输出文件并算出最终摘要
+void ReceiverSession::finishOutput()
+{
+    if (directWrite_)
+    {
+        // 多流传输的共享文件等最后一个流结束、最后一个引用释放时才关闭
+        writeOk_ = !directWriteFailed_;
+        if (!stripe_)
+            directFile_->close();
+    }
+    else
     {
-        std::cout << "[receiver] send FIN\n";
-        sendPacket(s, clientAddr, fin2, nullptr, 0);
+        writeOk_ = writer_->finish();
+        fout_.close();
+    }
+    if (!writeOk_)
+        std::cerr << tag_ << " write output file failed\n";
+    fileDigest_ = fileHash_.digest();
+}
 
-        // 等待客户端最后的 ACK
-        PacketHeader resp{};
-        std::vector<char> payload;
-        sockaddr_in from{};
-        if (!recvPacket(s, resp, payload, from))
-        {
-            std::cout << "[receiver] wait last ACK timeout\n";
-            continue;
-        }
 
-        if ((resp.flags & FLAG_ACK) && resp.ack == fin2.seq + 1)
-        {
-            std::cout << "[receiver] four-way close done\n";
-            break;
-        }
+// 发送端长时间没有任何分组：放弃这个会话，已经收到的数据照常落盘
+void ReceiverSession::abortSession(const char* why)
+{
+    std::cerr << tag_ << " " << why << "\n";
+    finishOutput();
+    state_  = State::Closed;
+    failed_ = true;
+}
+
+
+void ReceiverSession::onData(const PacketHeader& hdr, const char* data, uint16_t len,
+                             Clock::time_point now)
+{
+    ++dataPackets_;
+    if (!dataFits(hdr.seq, len))
+    {
+        if (dataRejected_++ == 0)
+            std::cerr << tag_ << " DATA " << hdr.seq << " has " << len
+                      << " bytes, payload size is " << payloadSize_ << ", dropped\n";
+        return;
     }
+    bool ackNow = acceptData(hdr.seq, data, len, hdr.reserved);
+    // 这个分组让某一组只差一个分组且校验分组已到：把缺的那个也还原出来
+    if (recoverFromFec())
+        ackNow = true;
 
-    closesocket(s);
+    ++pendingAcks_;
+    if (ackNow)
+    {
+        flushAck();
+        ++acksImmediate_;
+    }
+    else if (pendingAcks_ >= static_cast<uint32_t>(g_ackEvery))
+    {
+        flushAck();
+        ++acksByCount_;
+    }
+    else if (pendingAcks_ == 1)
+    {
+        ackDeadline_ = now + std::chrono::milliseconds(g_ackDelayMs);
+    }
+}
+
+
+// DATA 长度检查：超过负载大小的分组放不进缓冲块、会写到下一个分组的偏移上；
+// 定位写时短分组之后的分组偏移也会错，所以短分组只能是最后一个
+bool ReceiverSession::dataFits(uint32_t seq, uint16_t len)
+{
+    if (len > payloadSize_)
+        return false;
+    if (!directWrite_)
+        return true;
+    if (seq > tailSeq_)
+        return false;
+    if (len < payloadSize_)
+    {
+        if (seq < highestSeq_ || (tailSeq_ != UINT32_MAX && seq != tailSeq_))
+            return false;
+        tailSeq_ = seq;
+    }
+    highestSeq_ = std::max(highestSeq_, seq);
+    return true;
+}
+
+
+void ReceiverSession::onProbe(const PacketHeader& hdr, const char* data, uint16_t len)
+{
+    // 路径 MTU 探测：能收到就说明这个大小走得通，原样确认探测编号
+    PacketHeader probeAck{};
+    probeAck.ack   = hdr.seq;
+    probeAck.flags = FLAG_ACK | FLAG_PROBE | integrityFlag_;
+    probeAck.wnd   = advertisedWindow();
+    if (hdr.reserved != PROBE_COMMIT)
+    {
+        sendPacket(s_, peer_, probeAck, nullptr, 0);
+        ++probesAnswered_;
+        return;
+    }
+
+    // 探测结束：发送端换用更小的负载。只在还没收到 DATA 时生效（重发的通知照样确认），
+    // 确认中带回实际生效的大小，发送端不一致时放弃连接
+    uint16_t size = 0;
+    if (len >= sizeof(size))
+        std::memcpy(&size, data, sizeof(size));
+    if (dataPackets_ == 0 && size >= MAX_PAYLOAD && size <= negotiatedPayload_)
+    {
+        if (size != payloadSize_)
+            std::cout << tag_ << " payload size " << payloadSize_ << " -> " << size
+                      << " after path MTU probe\n";
+        payloadSize_ = size;
+    }
+    sendPacket(s_, peer_, probeAck, reinterpret_cast<const char*>(&payloadSize_),
+               sizeof(payloadSize_));
+}
+
+
+void ReceiverSession::onParity(const PacketHeader& hdr, const char* data, uint16_t len)
+{
+    // 校验分组：组内只差一个分组时立即还原，并马上确认让发送端不必重传
+    ++parityReceived_;
+    fec_.addParity(hdr, data, len);
+    if (recoverFromFec())
+    {
+        flushAck();
+        ++acksImmediate_;
+    }
+}
+
+
+void ReceiverSession::onFin(const PacketHeader& hdr, const char* data, uint16_t len,
+                            Clock::time_point now)
+{
+    std::cout << tag_ << " recv FIN\n";
+    finSeq_ = hdr.seq;
+    // FIN 负载是发送端的文件摘要
+    if (len >= FIN_DIGEST_BYTES)
+    {
+        std::memcpy(&peerDigest_, data, FIN_DIGEST_BYTES);
+        peerHasDigest_ = true;
+    }
+
+    finishOutput();
+    if (peerHasDigest_ && peerDigest_ != fileDigest_)
+        std::cerr << tag_ << " file digest mismatch, output is corrupt\n";
+
+    state_   = State::LastAck;
+    retries_ = 0;
+    sendFinReply(now);
+}
+
+
+// 把 seq 对应的一个分组交给磁盘：定位写直接写到文件偏移，否则追加到写盘队列
+void ReceiverSession::deliver(uint32_t seq, const char* buf, uint16_t bufLen)
+{
+    if (directWrite_)
+    {
+        uint64_t offset = baseOffset_ + static_cast<uint64_t>(seq - 1) * payloadSize_;
+        if (!directFile_->writeAt(offset, buf, bufLen) && !directWriteFailed_)
+        {
+            std::cerr << tag_ << " positional write failed\n";
+            directWriteFailed_ = true;
+        }
+    }
+    else
+    {
+        writer_->append(buf, bufLen);
+    }
+    bytesWritten_ += bufLen;
+}
+
+
+void ReceiverSession::hashInOrder(const char* buf, uint16_t bufLen)
+{
+    auto hashStart = Clock::now();
+    fileHash_.update(buf, bufLen);
+    hashNs_ += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - hashStart).count());
+}
+
+
+// 处理一个 DATA 分组（收到的或由前向纠错还原的），返回是否需要立即确认
+//fecGroupSize 为分组头部带来的纠错组大小，0 表示不计入纠错组
+bool ReceiverSession::acceptData(uint32_t seq, const char* payload, uint16_t payloadLen,
+                                 uint8_t fecGroupSize)
+{
+    bool ackNow = false;                 // 是否需要立即确认
+    bool isNew  = false;                 // 是否第一次收到这个序号
+    const uint32_t seqBefore = expectedSeq_;
+    if (seq >= expectedSeq_ && seq - expectedSeq_ < window_.cap)
+    {
+        if (seq == expectedSeq_)
+        {
+            // 恰好是期望的分组：直接从接收缓冲块交给磁盘，不经过乱序缓存
+            deliver(seq, payload, payloadLen);
+            hashInOrder(payload, payloadLen);
+            ++expectedSeq_;
+            isNew = true;
+        }
+        // 只缓存之前没收到的 seq
+        else if (!window_.occupied(seq))
+        {
+            ackNow = true;   // 乱序到达：立即让发送端看到空洞
+            isNew  = true;
+            if (directWrite_)
+            {
+                // 定位写：乱序分组也立即写到自己的偏移，位图只记完成
+                deliver(seq, payload, payloadLen);
+                window_.mark(seq, payloadLen);
+            }
+            else
+            {
+                //收到乱序数据先放进重组窗口，等缺失的前面分组到了一起写（只拷贝这一次）
+                window_.put(seq, payload, payloadLen);
+            }
+        }
+
+        // 把连续有序的分组写入文件（定位写模式下早已写入，只推进 expectedSeq）
+        while (window_.count > 0 && window_.occupied(expectedSeq_))
+        {
+            if (directWrite_)
+            {
+                // 乱序写入的分组没有留在内存里，按序读回来算摘要
+                uint16_t bufLen = window_.lengthOf(expectedSeq_);
+                uint64_t offset =
+                    baseOffset_ + static_cast<uint64_t>(expectedSeq_ - 1) * payloadSize_;
+                if (directFile_->readAt(offset, readBack_.data(), bufLen))
+                    hashInOrder(readBack_.data(), bufLen);
+                ++readBackPackets_;
+                window_.unmark(expectedSeq_);
+            }
+            else
+            {
+                //从重组窗口中取出对应序号的分组数据交给写盘队列，并释放槽位
+                uint16_t    bufLen = 0;
+                const char* buf    = window_.take(expectedSeq_, bufLen);
+                deliver(expectedSeq_, buf, bufLen);
+                hashInOrder(buf, bufLen);
+            }
+            ++expectedSeq_;
+        }
+        //这样就实现了一旦前边的窗口补齐，就可以把后面已经缓存好的连续段一次写出来
+
+        // 首次到达的分组计入所在的纠错组（还原出来的分组由 FecDecoder 自己记下）
+        if (isNew && fecGroupSize != 0)
+            fec_.addData(seq, fecGroupSize, payload, payloadLen);
+
+        // 补上空洞（一次推进了不止一个分组）或后面仍有空洞：立即确认
+        if (expectedSeq_ - seqBefore > 1 || window_.count > 0)
+            ackNow = true;
+    }
+    else
+    {
+        ackNow = true;   // 重复或超出窗口：可能是 ACK 丢了，立即重发确认
+    }
+
+    return ackNow;
+}
+
+
+// 把纠错组还原出来的分组按普通到达处理，返回是否还原了分组
+bool ReceiverSession::recoverFromFec()
+{
+    bool any = false;
+    uint32_t    seq = 0;
+    const char* payload = nullptr;
+    uint16_t    payloadLen = 0;
+    while (fec_.takeRecovered(seq, payload, payloadLen))
+    {
+        acceptData(seq, payload, payloadLen, 0);
+        ++fecRecovered_;
+        any = true;
+    }
+    return any;
+}
+
+
+// 通告窗口：
+//   定位写模式下乱序分组不占内存，窗口只受完成位图大小限制
+//   否则 = recvWindow_ - 已缓存的乱序分组数，写盘跟不上时再按写盘队列的剩余空间收紧，
+//   磁盘背压变成流量控制而不是丢包
+uint16_t ReceiverSession::advertisedWindow() const
+{
+    if (directWrite_)
+        return recvWindow_;
+    int freeSlots = std::min<int>(
+        static_cast<int>(recvWindow_) - static_cast<int>(window_.count),
+        static_cast<int>(std::min<size_t>(writer_->freePackets(), 0xFFFF)));
+    return static_cast<uint16_t>(std::max<int>(1, freeSlots));
+}
+
+
+void ReceiverSession::flushAck()
+{
+    //累计确认号，已经成功按序收到并写入文件的最大序号
+    uint32_t cumulativeAck = expectedSeq_ - 1;
+    //payload中带SACK信息，把窗口中所有比cumulativeAck大的分组区间都带上
+    sendAckWithSack(s_, peer_, cumulativeAck, window_,
+                    advertisedWindow(), integrityFlag_, bitmapSack_);
+    ++acksSent_;
+    pendingAcks_ = 0;
+}
+
+
+void ReceiverSession::printStats() const
+{
+    if (label_.empty())
+        std::cout << "===== RUDP Statistics (Receiver) =====\n";
+    else
+        std::cout << "===== RUDP Statistics (Receiver, " << label_ << ") =====\n";
+    std::cout << "Bytes written:         " << bytesWritten_ << " bytes\n";
+    std::cout << "Payload size:          " << payloadSize_ << " bytes ("
+              << ((options_ & OPT_PAYLOAD_SIZE) ? "negotiated" : "default");
+    if (payloadSize_ != negotiatedPayload_)
+        std::cout << " " << negotiatedPayload_ << ", probed down";
+    std::cout << ", probes answered=" << probesAnswered_ << ")\n";
+    std::cout << "Receive window:        " << recvWindow_ << " packets";
+    if (recvWindow_ < g_recvWindow)
+        std::cout << " (configured " << g_recvWindow << ", clamped to the "
+                  << (RECV_SESSION_BYTES_MAX >> 20) << " MB buffer budget)";
+    std::cout << "\n";
+    std::cout << "Packets received:      " << packets_
+              << " (acks sent=" << acksSent_;
+    if (dataRejected_ > 0)
+        std::cout << ", DATA dropped for bad length=" << dataRejected_;
+    std::cout << ")\n";
+    std::cout << "ACK coalescing:        " << (acksSent_ > 0
+                                                  ? static_cast<double>(dataPackets_) /
+                                                        static_cast<double>(acksSent_)
+                                                  : 0.0)
+              << " data pkts per ACK (every=" << g_ackEvery << ", delay=" << g_ackDelayMs
+              << "ms; immediate=" << acksImmediate_ << ", count=" << acksByCount_
+              << ", timer=" << acksByTimer_ << ")\n";
+    if (directWrite_)
+        std::cout << "Disk writer:           positional writes=" << directFile_->writes()
+                  << ", preallocated=" << (directFile_->preallocated() >> 20) << " MB"
+                  << (stripe_ ? " (shared by all streams)" : "") << "\n";
+    else
+        std::cout << "Disk writer:           chunks=" << writer_->chunksWritten()
+                  << " (" << (WRITE_CHUNK_BYTES >> 10) << " KB each), max queued="
+                  << writer_->maxQueued() << "/" << WRITE_QUEUE_CHUNKS
+                  << ", stalls=" << writer_->stalls() << "\n";
+    if (integrityFlag_)
+        std::cout << "Integrity:             crc32c (" << crc32cKernelName() << ")\n";
+    else
+        std::cout << "Integrity:             checksum16 (" << checksumKernelName() << ")\n";
+    if (parityReceived_ > 0)
+        std::cout << "FEC:                   xor, group=" << static_cast<int>(fec_.groupSize)
+                  << ", parity received=" << parityReceived_
+                  << ", packets recovered=" << fecRecovered_ << "\n";
+    if (bitmapSack_)
+        std::cout << "SACK format:           bitmap (up to " << MAX_SACK_BITMAP_BITS
+                  << " packets per ACK)\n";
+    else
+        std::cout << "SACK format:           blocks (up to " << MAX_SACK_BLOCKS
+                  << " ranges per ACK)\n";
+
+    double hashSec = static_cast<double>(hashNs_) / 1e9;
+    std::cout << "File digest:           xxh64=" << digestHex(fileDigest_)
+              << " (" << fileHash_.totalBytes() << " bytes hashed at "
+              << (hashSec > 0.0 ? static_cast<double>(fileHash_.totalBytes()) /
+                                      hashSec / (1024.0 * 1024.0)
+                                : 0.0)
+              << " MB/s";
+    if (directWrite_)
+        std::cout << ", read back=" << readBackPackets_ << " pkts";
+    std::cout << ")\n";
+    if (!peerHasDigest_)
+        std::cout << "Sender digest:         not reported\n";
+    else if (peerDigest_ == fileDigest_)
+        std::cout << "Sender digest:         match\n";
+    else
+        std::cout << "Sender digest:         MISMATCH (xxh64="
+                  << digestHex(peerDigest_) << ")\n";
+}
+
+// ============ 会话表 ============
+
+// 会话表的键：对端地址 + 端口 + 连接号（都按网络上的原样比较）
+struct SessionKey
+{
+    uint32_t addr;
+    uint16_t port;
+    uint32_t connId;
+
+    bool operator==(const SessionKey& o) const
+    {
+        return addr == o.addr && port == o.port && connId == o.connId;
+    }
+};
+
+struct SessionKeyHash
+{
+    size_t operator()(const SessionKey& k) const
+    {
+        uint64_t h = ((static_cast<uint64_t>(k.addr) << 16) | k.port) * 0x9E3779B97F4A7C15ull;
+        h ^= k.connId;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
+
+// 监听方式：
+//   recv 模式：只接受一个会话，写到 outputFile，这个会话结束就退出
+//   serve 模式：同时服务最多 maxSessions 个会话，每个会话写到 outputDir 下按对端和连接号命名的文件，
+//               workers > 1 时由分发线程按会话把数据报分给各工作线程
+struct ListenConfig
+{
+    size_t      maxSessions;
+    bool        singleShot;
+    std::string outputFile;
+    std::string outputDir;
+    size_t      workers;
+};
+
+// 会话名：对端 ip:port#连接号
+static std::string sessionLabel(const sockaddr_in& peer, uint32_t connId)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%s:%u#%08x", inet_ntoa(peer.sin_addr),
+                  static_cast<unsigned>(ntohs(peer.sin_port)), connId);
+    return buf;
+}
+
+// serve 模式的输出文件：<目录>/<ip>_<port>_<连接号>.bin
+static std::string sessionFileName(const std::string& dir, const sockaddr_in& peer,
+                                   uint32_t connId)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%s_%u_%08x.bin", inet_ntoa(peer.sin_addr),
+                  static_cast<unsigned>(ntohs(peer.sin_port)), connId);
+    return dir + "/" + buf;
+}
+
+// 多流传输的会话名：recv 模式为 stream i/K，serve 模式在对端会话名后加上流号
+static std::string streamLabel(const std::string& base, const StreamDescriptor& desc)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "stream %u/%u", static_cast<unsigned>(desc.index) + 1,
+                  static_cast<unsigned>(desc.count));
+    return base.empty() ? std::string(buf) : base + " " + buf;
+}
+
+// serve 模式多流传输的输出文件：<目录>/<ip>_<传输号>.bin，各流共用（端口每个流不同）
+static std::string stripeFileName(const std::string& dir, const sockaddr_in& peer,
+                                  uint32_t transferId)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%s_%08x.bin", inet_ntoa(peer.sin_addr), transferId);
+    return dir + "/" + buf;
+}
+
+// 多流传输结束（最后一个流关闭）：整个传输的汇总，调用方持有 g_statsMutex
+static void printStripeSummary(const StripedOutput& out)
+{
+    double sec = std::chrono::duration<double>(Clock::now() - out.firstOpened).count();
+    char id[16];
+    std::snprintf(id, sizeof(id), "%08x", out.transferId);
+    std::cout << "===== RUDP Statistics (Receiver, transfer " << id << ") =====\n";
+    std::cout << "Streams:               " << out.count << " (failed=" << out.streamsFailed
+              << ")\n";
+    std::cout << "Bytes written:         " << out.bytesWritten << " / " << out.fileSize
+              << " bytes\n";
+    std::cout << "Duration:              " << sec << " s\n";
+    std::cout << "Throughput:            "
+              << (sec > 0.0 ? static_cast<double>(out.bytesWritten) / sec / (1024.0 * 1024.0)
+                            : 0.0)
+              << " MB/s (aggregate)\n";
+}
+
+// 多个工作线程的会话统计和日志输出到同一个 stdout：整段统计在锁内输出，不穿插。
+// 只在会话结束时使用，不在收包路径上
+static std::mutex g_statsMutex;
+
+// 一张会话表：按 (对端地址, 连接号) 把分组分给各会话，只有 SYN 能建立新会话；
+// 处理到期的定时器并清理结束的会话。单线程接收时只有一张表，
+// --workers=N 时每个工作线程各有一张，只由本线程访问，不加锁。
+// 计数器用原子变量，只由所属线程写，汇总统计时别的线程可以读
+class SessionTable
+{
+public:
+    SessionTable(SOCKET s, const ListenConfig& cfg, size_t maxSessions)
+        : s_(s), cfg_(cfg), maxSessions_(maxSessions)
+    {
+    }
+
+    void dispatch(const RecvItem& item, Clock::time_point now)
+    {
+        SessionKey key{item.from.sin_addr.s_addr, item.from.sin_port,
+                       connectionIdOf(item.hdr)};
+        ReceiverSession* session = nullptr;
+        auto it = sessions_.find(key);
+        if (it != sessions_.end())
+            session = it->second.get();
+        else if ((item.hdr.flags & (FLAG_SYN | FLAG_ACK)) == FLAG_SYN)
+            session = open(key, item);
+        else
+            bump(strayPackets);
+        if (session)
+            session->onPacket(item.hdr, item.payload, item.payloadLen, now);
+    }
+
+    // 处理到期的定时器，清理已经结束的会话（结束时回调 onClosed 输出统计）
+    void runTimers(Clock::time_point now)
+    {
+        for (auto it = sessions_.begin(); it != sessions_.end();)
+        {
+            ReceiverSession& session = *it->second;
+            if (!session.closed() && session.nextDeadline() <= now)
+                session.onTimer(now);
+            if (!session.closed())
+            {
+                ++it;
+                continue;
+            }
+            bump(sessionsClosed);
+            if (session.failed())
+                bump(sessionsFailed);
+            {
+                std::lock_guard<std::mutex> lock(g_statsMutex);
+                if (session.established())
+                    session.printStats();
+                if (StripedOutput* stripe = session.stripe())
+                    if (releaseStripe(*stripe, session.failed(), session.bytesWritten()))
+                        printStripeSummary(*stripe);
+                it = sessions_.erase(it);
+                active.store(sessions_.size(), std::memory_order_relaxed);
+                if (onClosed)
+                    onClosed();
+            }
+            // recv 模式：多流传输时要等所有流都结束
+            if (cfg_.singleShot && sessionsClosed.load(std::memory_order_relaxed) >= expected_)
+                finished_ = true;
+        }
+    }
+
+    // 最早的会话截止时刻（延迟 ACK、重发、空闲超时），没有会话时为 time_point::max()
+    Clock::time_point nextDeadline() const
+    {
+        Clock::time_point deadline = Clock::time_point::max();
+        for (const auto& entry : sessions_)
+            deadline = std::min(deadline, entry.second->nextDeadline());
+        return deadline;
+    }
+
+    // recv 模式：唯一的会话已经结束，或者输出文件打不开
+    bool finished() const { return finished_; }
+
+    std::function<void()> onClosed;   // 会话结束、统计输出之后调用（持有 g_statsMutex）
+
+    std::atomic<uint64_t> active{0};
+    std::atomic<uint64_t> sessionsOpened{0};
+    std::atomic<uint64_t> sessionsClosed{0};
+    std::atomic<uint64_t> sessionsFailed{0};
+    std::atomic<uint64_t> synsRejected{0};   // 会话表已满时拒绝的 SYN
+    std::atomic<uint64_t> strayPackets{0};   // 不属于任何会话的非 SYN 分组（已结束的连接的迟到分组等）
+    std::atomic<int>      socketRecvBuffer{0};
+
+private:
+    // 只有本线程写，不需要原子的读改写
+    static void bump(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // 收到一个不属于任何会话的 SYN：协商选项、打开输出文件，建立新会话
+    ReceiverSession* open(const SessionKey& key, const RecvItem& item)
+    {
+        if (sessions_.size() >= maxSessions_)
+        {
+            bump(synsRejected);
+            return nullptr;
+        }
+        uint16_t         payloadSize = MAX_PAYLOAD;
+        uint16_t         window      = 1;
+        StreamDescriptor desc{};
+        uint8_t  options = negotiateOptions(item.hdr, item.payload, item.payloadLen,
+                                            payloadSize, desc, window);
+        const StreamDescriptor* stream = (options & OPT_STREAM) ? &desc : nullptr;
+
+        // recv 模式只接收一个传输：一个普通连接，或者同一个传输号的 K 个流
+        const uint64_t opened = sessionsOpened.load(std::memory_order_relaxed);
+        if (cfg_.singleShot && opened > 0 &&
+            (!stream || !transferId_ || desc.transferId != *transferId_ ||
+             opened >= expected_))
+        {
+            bump(synsRejected);
+            return nullptr;
+        }
+
+        std::string label = cfg_.singleShot ? "" : sessionLabel(item.from, key.connId);
+        if (stream)
+            label = streamLabel(label, desc);
+        // 会话的缓冲（重组环、写盘队列）在这里一次分配好；预算之内仍然分配失败时
+        // 拒绝这个 SYN，发送端会重发 SYN，而不是让异常打断整个监听端
+        std::unique_ptr<ReceiverSession> session;
+        bool openOk = false;
+        try
+        {
+            session = std::make_unique<ReceiverSession>(s_, item.from, key.connId, options,
+                                                        payloadSize, window, label, stream);
+            if (stream)
+            {
+                std::string outputFile = cfg_.singleShot
+                                             ? cfg_.outputFile
+                                             : stripeFileName(cfg_.outputDir, item.from,
+                                                              desc.transferId);
+                auto stripe = acquireStripe(item.from.sin_addr.s_addr, desc, outputFile);
+                if (stripe)
+                    session->attachStripe(std::move(stripe));
+                else
+                    std::cerr << "[receiver " << label << "] open striped output failed: "
+                              << outputFile << "\n";
+                openOk = session->stripe() != nullptr;
+            }
+            else
+            {
+                openOk = session->openOutput(cfg_.singleShot
+                                                 ? cfg_.outputFile
+                                                 : sessionFileName(cfg_.outputDir, item.from,
+                                                                   key.connId));
+            }
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::cerr << (label.empty() ? "[receiver]" : "[receiver " + label + "]")
+                      << " out of memory for a " << window << " x " << payloadSize
+                      << "-byte receive window, SYN rejected\n";
+            bump(synsRejected);
+            return nullptr;
+        }
+        if (!openOk)
+        {
+            if (cfg_.singleShot && opened == 0)
+                finished_ = true;
+            return nullptr;
+        }
+        if (cfg_.singleShot && opened == 0 && stream)
+        {
+            transferId_ = desc.transferId;
+            expected_   = desc.count;
+        }
+        std::cout << (label.empty() ? "[receiver]" : "[receiver " + label + "]")
+                  << " recv SYN\n";
+        // 套接字接收缓冲区至少放得下每个会话一个通告窗口的分组
+        socketRecvBuffer.store(
+            growSocketBuffer(s_, SO_RCVBUF,
+                             (sessions_.size() + 1) * cfg_.workers *
+                                 static_cast<size_t>(session->recvWindow()) *
+                                 session->packetBytes()),
+            std::memory_order_relaxed);
+        bump(sessionsOpened);
+        ReceiverSession* raw = session.get();
+        sessions_.emplace(key, std::move(session));
+        active.store(sessions_.size(), std::memory_order_relaxed);
+        return raw;
+    }
+
+    SOCKET              s_;
+    const ListenConfig& cfg_;
+    size_t              maxSessions_;
+    bool                finished_ = false;
+    // recv 模式：接收的传输（多流传输时为传输号）和要等它结束的会话数
+    std::optional<uint32_t> transferId_;
+    uint64_t                expected_ = 1;
+    std::unordered_map<SessionKey, std::unique_ptr<ReceiverSession>, SessionKeyHash> sessions_;
+};
+
+// ============ 多线程接收：分发线程 + 工作线程 ============
+
+// 分发线程（生产者）→ 工作线程（消费者）的数据报环：变长记录首尾相接放在一块字节环里，
+// 和 DiskWriter 的块队列一样只靠 head_ / tail_ 两个单调递增的原子字节下标，不加锁。
+// 记录 = [RecordHeader][数据报]，按 8 字节对齐；环尾放不下一条记录时跳到环首，
+// 尾部剩余空间够放记录头时写一个 len = WRAP 的跳转标记
+class DatagramRing
+{
+public:
+    struct RecordHeader
+    {
+        uint32_t    len;
+        sockaddr_in from;
+    };
+
+    explicit DatagramRing(size_t capacity) : cap_(capacity), data_(capacity) {}
+
+    // 生产者：放入一个数据报，环满返回 false（相当于套接字缓冲区溢出，分组丢弃）
+    bool push(const char* datagram, size_t len, const sockaddr_in& from)
+    {
+        size_t need = recordBytes(len);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t pos  = tail % cap_;
+        size_t skip = (cap_ - pos < need) ? cap_ - pos : 0;
+        if (tail + skip + need - head_.load(std::memory_order_acquire) > cap_)
+            return false;
+        if (skip >= sizeof(RecordHeader))
+        {
+            RecordHeader wrap{WRAP, {}};
+            std::memcpy(&data_[pos], &wrap, sizeof(wrap));
+        }
+        pos = (tail + skip) % cap_;
+        RecordHeader rec{static_cast<uint32_t>(len), from};
+        std::memcpy(&data_[pos], &rec, sizeof(rec));
+        std::memcpy(&data_[pos + sizeof(rec)], datagram, len);
+        // 顺序一致的 store：和工作线程睡前的 empty() 检查配对，不会漏掉唤醒
+        tail_.store(tail + skip + need);
+        return true;
+    }
+
+    // 消费者：取最早的一条记录，环空返回 false；数据在 pop() 之前有效
+    bool front(const char*& datagram, size_t& len, sockaddr_in& from)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        size_t pos = head % cap_;
+        RecordHeader rec{};
+        if (cap_ - pos >= sizeof(RecordHeader))
+            std::memcpy(&rec, &data_[pos], sizeof(rec));
+        if (cap_ - pos < sizeof(RecordHeader) || rec.len == WRAP)
+        {
+            // 跳转标记（或放不下记录头的环尾）：生产者发布时已经把跳过的部分算进了 tail
+            head += cap_ - pos;
+            head_.store(head, std::memory_order_release);
+            pos = 0;
+            std::memcpy(&rec, &data_[0], sizeof(rec));
+        }
+        datagram = &data_[pos + sizeof(RecordHeader)];
+        len      = rec.len;
+        from     = rec.from;
+        return true;
+    }
+
+    void pop(size_t len)
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + recordBytes(len),
+                    std::memory_order_release);
+    }
+
+    bool empty() const { return head_.load() == tail_.load(); }
+
+private:
+    static constexpr uint32_t WRAP = UINT32_MAX;
+
+    static size_t recordBytes(size_t len)
+    {
+        return (sizeof(RecordHeader) + len + 7) & ~size_t(7);
+    }
+
+    size_t              cap_;
+    std::vector<char>   data_;
+    std::atomic<size_t> head_{0};   // 工作线程下一个要读的字节（单调递增）
+    std::atomic<size_t> tail_{0};   // 分发线程下一个要写的字节（单调递增）
+};
+
+// 一个工作线程：自己的数据报环和会话表。分组的校验、重组、写盘、回 ACK 都在本线程完成，
+// 与分发线程只通过数据报环交接；空闲时睡在自己的条件变量上，
+// 分发线程只有看到它在睡（sleeping）时才加锁唤醒，忙时收包路径上没有锁
+struct ReceiverWorker
+{
+    ReceiverWorker(SOCKET s, const ListenConfig& cfg, size_t maxSessions)
+        : ring(WORKER_RING_BYTES), table(s, cfg, maxSessions)
+    {
+    }
+
+    DatagramRing ring;
+    SessionTable table;
+    std::thread  thread;
+
+    std::mutex              idleMutex;
+    std::condition_variable idleCv;
+    std::atomic<bool>       sleeping{false};
+
+    // 计数：packets / bytes / wakeups 只由工作线程写，drops 只由分发线程写
+    std::atomic<uint64_t> packets{0};   // 校验通过、交给会话表的分组数
+    std::atomic<uint64_t> bytes{0};     // 收到的数据报字节数
+    std::atomic<uint64_t> wakeups{0};   // 从睡眠中醒来的次数
+    std::atomic<uint64_t> drops{0};     // 数据报环满丢弃的数据报数
+};
+
+static void addRelaxed(std::atomic<uint64_t>& counter, uint64_t n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static void workerLoop(ReceiverWorker& w)
+{
+    std::vector<RecvItem> items;
+    while (true)
+    {
+        // 把环里的数据报取完：拆分校验后交给本线程的会话表
+        Clock::time_point now = Clock::now();
+        const char* datagram = nullptr;
+        size_t      len = 0;
+        sockaddr_in from{};
+        size_t      taken = 0;
+        while (w.ring.front(datagram, len, from))
+        {
+            items.clear();
+            parseDatagram(datagram, len, from, items);
+            for (const RecvItem& item : items)
+                w.table.dispatch(item, now);
+            addRelaxed(w.packets, items.size());
+            addRelaxed(w.bytes, len);
+            w.ring.pop(len);
+            if (++taken % static_cast<size_t>(g_ioBatchSize) == 0)
+                now = Clock::now();
+        }
+        w.table.runTimers(Clock::now());
+        if (!w.ring.empty())
+            continue;
+
+        // 环空：睡到最早的会话截止时刻，或者分发线程送来新的数据报
+        std::unique_lock<std::mutex> lock(w.idleMutex);
+        w.sleeping.store(true);
+        if (w.ring.empty())
+        {
+            Clock::time_point deadline = w.table.nextDeadline();
+            auto ready = [&]() { return !w.ring.empty(); };
+            if (deadline == Clock::time_point::max())
+                w.idleCv.wait(lock, ready);
+            else
+                w.idleCv.wait_until(lock, deadline, ready);
+            addRelaxed(w.wakeups, 1);
+        }
+        w.sleeping.store(false);
+    }
+}
+
+// ============ 监听循环 ============
+
+// 一个套接字上的接收端：所有分组由这里收进来，按 (对端地址, 连接号) 交给会话表；
+// 单线程时每轮只睡到最早的会话截止时刻。
+// --workers=N（N > 1）时本线程只做分发：收下数据报、读出头部里的连接号，
+// 按会话键哈希放进对应工作线程的数据报环，同一会话的分组总在同一个工作线程上处理
+static void serveSessions(uint16_t port, const ListenConfig& cfg)
+{
+    //创建UDP套接字并绑定端口
+    SOCKET s = openUdpSocket(g_registeredIo);
+    if (s == INVALID_SOCKET)
+    {
+        printLastError("socket");
+        return;
+    }
+
+    sockaddr_in local{};
+    local.sin_family      = AF_INET;
+    local.sin_addr.s_addr = INADDR_ANY;
+    local.sin_port        = htons(port);
+    //绑定端口
+    if (bind(s, reinterpret_cast<sockaddr*>(&local),
+             sizeof(local)) == SOCKET_ERROR)
+    {
+        printLastError("bind");
+        closesocket(s);
+        return;
+    }
+
+    // 批量接收：每次唤醒把已到达的数据报一次取完
+    const size_t batchLimit = static_cast<size_t>(g_ioBatchSize);
+    std::atomic<uint64_t> rxBatches{0}, rxPackets{0};
+
+    // 接收合并（URO）：一次 recvfrom 可能拿到多个首尾相接的分组，由 recvPacketBatch 拆开
+    bool recvOffload = false;
+    if (g_udpOffload)
+    {
+        recvOffload = enableRecvOffload(s, true);
+        std::cout << (recvOffload
+                          ? "[receiver] UDP receive offload enabled\n"
+                          : "[receiver] UDP receive offload unavailable, fallback to plain recv\n");
+    }
+    // 接收缓冲：各会话协商的负载不同，每块按本端接受的最大分组分配，
+    // 开启 URO 时要能放下一个合并后的超级数据报
+    const size_t slabBytes = recvOffload ? MAX_OFFLOAD_BYTES
+                                         : sizeof(ExtPacketHeader) + receiverPayloadLimit();
+
+    // Registered I/O：RIO_RECV_SLOTS 个接收块一直投递着，数据报直接落进注册缓冲，
+    // 一次唤醒从完成队列取回一批。ACK 仍由各会话用 sendto 发出
+    std::unique_ptr<RioQueue> rio;
+    if (g_registeredIo)
+    {
+        rio = std::make_unique<RioQueue>();
+        if (rio->open(s, 0, RIO_RECV_SLOTS, slabBytes))
+        {
+            std::cout << "[receiver] registered I/O enabled, " << rio->recvSlots()
+                      << " receive slots (" << (rio->registeredBytes() >> 20) << " MB)\n";
+        }
+        else
+        {
+            rio.reset();
+            std::cout << "[receiver] registered I/O unavailable, fallback to plain recv\n";
+        }
+    }
+    // 监听线程睡在截止时刻和数据报到达上：RIO 时等接收完成队列的通知事件，
+    // 否则等套接字可读事件（关联事件后套接字即为非阻塞）
+    SocketWaiter waiter = rio ? SocketWaiter(rio->notifyEvent()) : SocketWaiter(s);
+    const Clock::time_point listenStart = Clock::now();
+
+    // 每个工作线程一张会话表；单线程时就是本线程自己的一张
+    const size_t workerCount = std::max<size_t>(1, cfg.workers);
+    const size_t perWorkerSessions = (cfg.maxSessions + workerCount - 1) / workerCount;
+    std::vector<std::unique_ptr<ReceiverWorker>> workers;
+    for (size_t i = 0; i < workerCount; ++i)
+        workers.push_back(std::make_unique<ReceiverWorker>(s, cfg, perWorkerSessions));
+
+    // 汇总统计：调用方持有 g_statsMutex
+    auto printListenerStats = [&]()
+    {
+        uint64_t batches = rxBatches.load(std::memory_order_relaxed);
+        uint64_t packets = rxPackets.load(std::memory_order_relaxed);
+        int      rcvbuf  = 0;
+        uint64_t active = 0, opened = 0, closed = 0, failed = 0, rejected = 0, stray = 0;
+        for (const auto& w : workers)
+        {
+            rcvbuf    = std::max(rcvbuf, w->table.socketRecvBuffer.load());
+            active   += w->table.active.load();
+            opened   += w->table.sessionsOpened.load();
+            closed   += w->table.sessionsClosed.load();
+            failed   += w->table.sessionsFailed.load();
+            rejected += w->table.synsRejected.load();
+            stray    += w->table.strayPackets.load();
+        }
+        std::cout << "Recv batches:          " << batches << " (avg "
+                  << (batches > 0 ? static_cast<double>(packets) /
+                                        static_cast<double>(batches)
+                                  : 0.0)
+                  << " pkts, limit=" << batchLimit
+                  << ", UDP offload " << (recvOffload ? "on" : "off")
+                  << ", socket recv buffer=" << (rcvbuf >> 10) << " KB)\n";
+        if (rio)
+            std::cout << "Registered I/O:        recv slots=" << rio->recvSlots()
+                      << ", completions=" << rio->recvsReaped() << " (avg "
+                      << (rio->recvDequeues() > 0
+                              ? static_cast<double>(rio->recvsReaped()) /
+                                    static_cast<double>(rio->recvDequeues())
+                              : 0.0)
+                      << " per dequeue), registered=" << (rio->registeredBytes() >> 20)
+                      << " MB\n";
+        else
+            std::cout << "Registered I/O:        off\n";
+        // 监听线程的唤醒次数：多线程时只做分发，只会因数据报到达醒来
+        double listenSec = std::chrono::duration<double>(Clock::now() - listenStart).count();
+        std::cout << "Event loop:            wakeups=" << waiter.wakeups() << " ("
+                  << (listenSec > 0.0 ? static_cast<double>(waiter.wakeups()) / listenSec : 0.0)
+                  << "/s, deadline=" << waiter.timerWakeups()
+                  << "), timer=" << (waiter.highResolution() ? "high-resolution" : "default")
+                  << "\n";
+        if (cfg.singleShot)
+            return;
+        std::cout << "Sessions:              active=" << active
+                  << ", opened=" << opened << ", closed=" << closed
+                  << " (failed=" << failed << "), SYNs rejected=" << rejected
+                  << ", stray packets=" << stray << "\n";
+        if (workerCount > 1)
+            for (size_t i = 0; i < workerCount; ++i)
+            {
+                const ReceiverWorker& w = *workers[i];
+                std::cout << "Worker " << i << ":              packets="
+                          << w.packets.load() << ", bytes=" << w.bytes.load()
+                          << ", sessions active=" << w.table.active.load()
+                          << " opened=" << w.table.sessionsOpened.load()
+                          << ", ring drops=" << w.drops.load()
+                          << ", wakeups=" << w.wakeups.load() << " ("
+                          << (listenSec > 0.0 ? static_cast<double>(w.wakeups.load()) /
+                                                    listenSec
+                                              : 0.0)
+                          << "/s)\n";
+            }
+    };
+    if (!cfg.singleShot)
+        for (auto& w : workers)
+            w->table.onClosed = printListenerStats;
+
+    if (cfg.singleShot)
+        std::cout << "[receiver] wait for SYN...\n";
+    else
+        std::cout << "[receiver] serving on port " << port << ", max sessions="
+                  << cfg.maxSessions << ", workers=" << workerCount
+                  << ", output dir=" << cfg.outputDir << "\n";
+
+    if (workerCount == 1)
+    {
+        SessionTable& table = workers[0]->table;
+        RecvBatch rxBatch(rio ? 0 : batchLimit, slabBytes);
+        std::vector<RioDatagram> rioBatch;
+        std::vector<RecvItem>    rioItems;
+        // 一次唤醒收进来的分组：RIO 时取回一批完成的数据报再逐个拆开校验
+        auto receive = [&]() -> const std::vector<RecvItem>&
+        {
+            if (!rio)
+            {
+                recvPacketBatch(s, rxBatch, batchLimit);
+                return rxBatch.items;
+            }
+            rio->notified();
+            rio->recvBatch(rioBatch, batchLimit);
+            rioItems.clear();
+            for (const RioDatagram& d : rioBatch)
+                parseDatagram(d.data, d.len, d.from, rioItems);
+            return rioItems;
+        };
+        while (!table.finished())
+        {
+            // recv 模式可以被 g_stopReceiver 叫停：放弃还没结束的会话，不再等 SYN
+            if (cfg.singleShot && g_stopReceiver.load())
+            {
+                std::cout << "[receiver] stopped before the transfer finished\n";
+                break;
+            }
+            // 只睡到最早的会话截止时刻；没有会话时 serve 模式一直等 SYN，
+            // recv 模式至少每 RECV_STOP_POLL_MS 醒来检查一次停止标志
+            Clock::time_point deadline = table.nextDeadline();
+            if (cfg.singleShot)
+                deadline = std::min(deadline, Clock::now() +
+                                                  std::chrono::milliseconds(RECV_STOP_POLL_MS));
+            if (rio)
+                rio->armNotify();
+            if (waiter.wait(deadline))
+            {
+                const std::vector<RecvItem>& items = receive();
+                if (!items.empty())
+                {
+                    addRelaxed(rxBatches, 1);
+                    addRelaxed(rxPackets, items.size());
+                }
+                const Clock::time_point now = Clock::now();
+                for (const RecvItem& item : items)
+                    table.dispatch(item, now);
+            }
+            table.runTimers(Clock::now());
+        }
+    }
+    else
+    {
+        for (auto& w : workers)
+        {
+            ReceiverWorker* raw = w.get();
+            w->thread = std::thread([raw]() { workerLoop(*raw); });
+        }
+
+        // 分发：数据报先收进本线程的缓冲，只看头部取出会话键，再整个拷进对应工作线程的环。
+        // 校验放在工作线程做；坏包在那里丢弃
+        std::vector<char>  datagram(rio ? 0 : slabBytes);
+        std::vector<RioDatagram> rioBatch;
+        std::vector<bool>  touched(workerCount, false);
+        SessionKeyHash     hasher;
+        size_t got = 0;
+        auto route = [&](const char* data, size_t len, const sockaddr_in& from)
+        {
+            if (len < sizeof(PacketHeader))
+                return;
+            PacketHeader hdr{};
+            std::memcpy(&hdr, data, sizeof(hdr));
+            SessionKey key{from.sin_addr.s_addr, from.sin_port, connectionIdOf(hdr)};
+            size_t idx = hasher(key) % workerCount;
+            if (workers[idx]->ring.push(data, len, from))
+                touched[idx] = true;
+            else
+                addRelaxed(workers[idx]->drops, 1);
+            ++got;
+        };
+        while (true)
+        {
+            if (rio)
+                rio->armNotify();
+            if (!waiter.wait(Clock::time_point::max()))
+                continue;
+            got = 0;
+            if (rio)
+            {
+                rio->notified();
+                rio->recvBatch(rioBatch, batchLimit);
+                for (const RioDatagram& d : rioBatch)
+                    route(d.data, d.len, d.from);
+            }
+            for (size_t attempt = 0; !rio && attempt < batchLimit; ++attempt)
+            {
+                sockaddr_in from{};
+                int fromLen = sizeof(from);
+                int ret = recvfrom(s, datagram.data(), static_cast<int>(datagram.size()), 0,
+                                   reinterpret_cast<sockaddr*>(&from), &fromLen);
+                if (ret == SOCKET_ERROR)
+                {
+                    int err = WSAGetLastError();
+                    if (err == WSAEWOULDBLOCK || err == WSAETIMEDOUT)
+                        break;
+                    printLastError("recvfrom");
+                    continue;
+                }
+                route(datagram.data(), static_cast<size_t>(ret), from);
+            }
+            if (got > 0)
+            {
+                addRelaxed(rxBatches, 1);
+                addRelaxed(rxPackets, got);
+            }
+            // 一批分发完再唤醒：只叫醒正在睡的工作线程
+            for (size_t i = 0; i < workerCount; ++i)
+            {
+                if (!touched[i])
+                    continue;
+                touched[i] = false;
+                ReceiverWorker& w = *workers[i];
+                if (w.sleeping.load())
+                {
+                    std::lock_guard<std::mutex> lock(w.idleMutex);
+                    w.idleCv.notify_one();
+                }
+            }
+        }
+    }
+
+    if (recvOffload)
+        enableRecvOffload(s, false);
+    closesocket(s);
+    g_dataPath.rxBatches += rxBatches.load();
+    g_dataPath.rxPackets += rxPackets.load();
+    if (rio)
+    {
+        g_dataPath.rioReceiver = true;
+        g_dataPath.rioRecvs    += rio->recvsReaped();
+        g_dataPath.rioDequeues += rio->recvDequeues();
+    }
+    if (workers[0]->table.sessionsOpened.load() > 0)
+        printListenerStats();
+}
+
+// ============ 接收端主逻辑 ============
+
+void runReceiver(uint16_t port, const std::string& outputFile)
+{
+    // 会话上限按最多的流数给，同一时刻仍然只接收一个传输
+    serveSessions(port, ListenConfig{MAX_STREAMS, true, outputFile, "", 1});
+}
+
+void runServer(uint16_t port, const std::string& outputDir)
+{
+    serveSessions(port, ListenConfig{static_cast<size_t>(g_maxSessions), false, "",
+                                     outputDir, static_cast<size_t>(g_recvWorkers)});
 }
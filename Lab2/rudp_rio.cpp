@@ -0,0 +1,330 @@
+// rudp_rio.cpp —— Registered I/O（RIO）数据通路
+#include "rudp_rio.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <mutex>
+
+#ifndef WSA_FLAG_REGISTERED_IO
+#define WSA_FLAG_REGISTERED_IO 0x100   // 旧版 SDK 没有这个定义
+#endif
+
+// RIO 函数不直接导出，要通过 WSAIoctl 从某个套接字取出函数表；整个进程只取一次
+static RIO_EXTENSION_FUNCTION_TABLE g_rio{};
+static bool                         g_rioLoaded = false;
+static std::once_flag               g_rioOnce;
+
+static bool loadRioTable(SOCKET s)
+{
+    std::call_once(g_rioOnce, [s]()
+    {
+        GUID  id = WSAID_MULTIPLE_RIO;
+        DWORD bytes = 0;
+        g_rio.cbSize = sizeof(g_rio);
+        g_rioLoaded = WSAIoctl(s, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER,
+                               &id, sizeof(id), &g_rio, sizeof(g_rio), &bytes,
+                               nullptr, nullptr) == 0;
+    });
+    return g_rioLoaded;
+}
+
+
+SOCKET openUdpSocket(bool registeredIo)
+{
+    if (registeredIo)
+    {
+        SOCKET s = WSASocketW(AF_INET, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0,
+                              WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+        if (s != INVALID_SOCKET)
+            return s;
+    }
+    return socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+}
+
+
+RioQueue::~RioQueue()
+{
+    close();
+}
+
+
+size_t RioQueue::addrOffset(size_t idx) const
+{
+    return (sendSlots_ + recvSlots_) * slotBytes_ + idx * sizeof(SOCKADDR_INET);
+}
+
+
+bool RioQueue::open(SOCKET s, size_t sendSlots, size_t recvSlots, size_t slotBytes)
+{
+    if (!loadRioTable(s))
+        return false;
+
+    s_         = s;
+    slotBytes_ = (slotBytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    sendSlots_ = sendSlots;
+    recvSlots_ = recvSlots;
+
+    // 缓冲区按页分配，整块注册一次；每个块另有一个地址槽（发送的目的地址 / 接收的来源地址）
+    regionBytes_ = addrOffset(sendSlots_ + recvSlots_);
+    region_ = static_cast<char*>(
+        VirtualAlloc(nullptr, regionBytes_, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (region_ == nullptr)
+    {
+        close();
+        return false;
+    }
+    bufferId_ = g_rio.RIORegisterBuffer(region_, static_cast<DWORD>(regionBytes_));
+    if (bufferId_ == RIO_INVALID_BUFFERID)
+    {
+        printLastError("RIORegisterBuffer");
+        close();
+        return false;
+    }
+
+    // 两个完成队列各绑定一个事件：接收完成供监听循环睡眠等待；
+    // 发送完成平时在发送前轮询，只有发送块用完时才等它的事件
+    notifyEvent_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    sendEvent_   = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    RIO_NOTIFICATION_COMPLETION recvNotify{};
+    recvNotify.Type              = RIO_EVENT_COMPLETION;
+    recvNotify.Event.EventHandle = notifyEvent_;
+    recvNotify.Event.NotifyReset = TRUE;
+    RIO_NOTIFICATION_COMPLETION sendNotify = recvNotify;
+    sendNotify.Event.EventHandle = sendEvent_;
+    const DWORD sendDepth = static_cast<DWORD>(std::max<size_t>(1, sendSlots_));
+    const DWORD recvDepth = static_cast<DWORD>(std::max<size_t>(1, recvSlots_));
+    sendCq_ = sendEvent_ ? g_rio.RIOCreateCompletionQueue(sendDepth, &sendNotify)
+                         : RIO_INVALID_CQ;
+    recvCq_ = notifyEvent_ ? g_rio.RIOCreateCompletionQueue(recvDepth, &recvNotify)
+                           : RIO_INVALID_CQ;
+    if (sendCq_ == RIO_INVALID_CQ || recvCq_ == RIO_INVALID_CQ)
+    {
+        printLastError("RIOCreateCompletionQueue");
+        close();
+        return false;
+    }
+    rq_ = g_rio.RIOCreateRequestQueue(s_, recvDepth, 1, sendDepth, 1, recvCq_, sendCq_, nullptr);
+    if (rq_ == RIO_INVALID_RQ)
+    {
+        printLastError("RIOCreateRequestQueue");
+        close();
+        return false;
+    }
+    results_.resize(std::max(sendDepth, recvDepth));
+
+    freeSend_.clear();
+    for (size_t i = sendSlots_; i > 0; --i)
+        freeSend_.push_back(static_cast<uint32_t>(i - 1));
+
+    // 接收块全部投递出去，之后一直保持投递状态
+    for (size_t i = 0; i < recvSlots_; ++i)
+    {
+        if (!postRecv(sendSlots_ + i, i + 1 < recvSlots_))
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void RioQueue::close()
+{
+    // 请求队列随套接字关闭释放，没有单独的关闭函数
+    rq_ = RIO_INVALID_RQ;
+    if (recvCq_ != RIO_INVALID_CQ)
+        g_rio.RIOCloseCompletionQueue(recvCq_);
+    if (sendCq_ != RIO_INVALID_CQ)
+        g_rio.RIOCloseCompletionQueue(sendCq_);
+    recvCq_ = sendCq_ = RIO_INVALID_CQ;
+    if (bufferId_ != RIO_INVALID_BUFFERID)
+        g_rio.RIODeregisterBuffer(bufferId_);
+    bufferId_ = RIO_INVALID_BUFFERID;
+    if (notifyEvent_)
+        CloseHandle(notifyEvent_);
+    if (sendEvent_)
+        CloseHandle(sendEvent_);
+    notifyEvent_ = sendEvent_ = nullptr;
+    if (region_)
+        VirtualFree(region_, 0, MEM_RELEASE);
+    region_ = nullptr;
+    heldRecv_.clear();
+    freeSend_.clear();
+}
+
+
+bool RioQueue::postRecv(size_t idx, bool defer)
+{
+    RIO_BUF data{bufferId_, static_cast<ULONG>(idx * slotBytes_),
+                 static_cast<ULONG>(slotBytes_)};
+    RIO_BUF addr{bufferId_, static_cast<ULONG>(addrOffset(idx)),
+                 static_cast<ULONG>(sizeof(SOCKADDR_INET))};
+    if (!g_rio.RIOReceiveEx(rq_, &data, 1, nullptr, &addr, nullptr, nullptr,
+                            defer ? RIO_MSG_DEFER : 0, reinterpret_cast<PVOID>(idx)))
+    {
+        printLastError("RIOReceiveEx");
+        return false;
+    }
+    return true;
+}
+
+
+bool RioQueue::reapSends()
+{
+    ULONG n = g_rio.RIODequeueCompletion(sendCq_, results_.data(),
+                                         static_cast<ULONG>(sendSlots_));
+    if (n == RIO_CORRUPT_CQ)
+    {
+        std::cerr << "RIODequeueCompletion: send completion queue corrupt\n";
+        return false;
+    }
+    // 发送失败（Status != 0）的数据报和链路上丢失的一样，由重传恢复
+    for (ULONG i = 0; i < n; ++i)
+        freeSend_.push_back(static_cast<uint32_t>(results_[i].RequestContext));
+    return true;
+}
+
+
+// 发送块用完：已投递的发送都已提交，睡在发送完成队列的事件上等它们完成。
+// RIONotify 时队列里已有完成则事件立即置位；RIO_SEND_WAIT_MS 内一个完成都没有就放弃
+bool RioQueue::waitSendSlot()
+{
+    using WaitClock = std::chrono::steady_clock;
+    const WaitClock::time_point deadline =
+        WaitClock::now() + std::chrono::milliseconds(RIO_SEND_WAIT_MS);
+    while (freeSend_.empty())
+    {
+        int ret = g_rio.RIONotify(sendCq_);
+        if (ret != 0 && ret != WSAEALREADY)
+        {
+            std::cerr << "RIONotify: send completion queue error " << ret << "\n";
+            return false;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - WaitClock::now());
+        if (left.count() < 0)
+            left = std::chrono::milliseconds(0);
+        DWORD waited = WaitForSingleObject(sendEvent_, static_cast<DWORD>(left.count()));
+        if (!reapSends())
+            return false;
+        if (freeSend_.empty() && (waited != WAIT_OBJECT_0 || WaitClock::now() >= deadline))
+        {
+            std::cerr << "RIODequeueCompletion: no send completion within "
+                      << RIO_SEND_WAIT_MS << " ms\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool RioQueue::commitSends()
+{
+    if (deferred_ == 0)
+        return true;
+    deferred_ = 0;
+    ++sendCommits_;
+    if (!g_rio.RIOSendEx(rq_, nullptr, 0, nullptr, nullptr, nullptr, nullptr,
+                         RIO_MSG_COMMIT_ONLY, nullptr))
+    {
+        printLastError("RIOSendEx");
+        return false;
+    }
+    return true;
+}
+
+
+bool RioQueue::sendBatch(const sockaddr_in& to, const OutPacket* pkts, size_t count)
+{
+    if (!reapSends())
+        return false;
+
+    bool delayed = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const OutPacket& p = pkts[i];
+        if (!emulateLinkInBatch(p.hdr, delayed))
+            continue;
+
+        // 发送块用完：先把已投递的提交出去，等它们完成腾出块
+        if (freeSend_.empty())
+        {
+            ++sendWaits_;
+            if (!commitSends() || !waitSendSlot())
+                return false;
+        }
+        uint32_t idx = freeSend_.back();
+        freeSend_.pop_back();
+
+        size_t len = sealPacket(slot(idx), p.hdr, p.payload, p.payloadLen);
+        SOCKADDR_INET dest{};
+        std::memcpy(&dest.Ipv4, &to, sizeof(to));
+        std::memcpy(region_ + addrOffset(idx), &dest, sizeof(dest));
+
+        RIO_BUF data{bufferId_, static_cast<ULONG>(idx * slotBytes_), static_cast<ULONG>(len)};
+        RIO_BUF addr{bufferId_, static_cast<ULONG>(addrOffset(idx)),
+                     static_cast<ULONG>(sizeof(SOCKADDR_INET))};
+        if (!g_rio.RIOSendEx(rq_, &data, 1, nullptr, &addr, nullptr, nullptr, RIO_MSG_DEFER,
+                             reinterpret_cast<PVOID>(static_cast<size_t>(idx))))
+        {
+            printLastError("RIOSendEx");
+            freeSend_.push_back(idx);
+            return false;
+        }
+        ++deferred_;
+        ++sendsPosted_;
+    }
+    return commitSends();
+}
+
+
+size_t RioQueue::recvBatch(std::vector<RioDatagram>& out, size_t maxCount)
+{
+    // 上一批调用方已经处理完，接收块整批重新投递
+    for (size_t i = 0; i < heldRecv_.size(); ++i)
+        postRecv(heldRecv_[i], i + 1 < heldRecv_.size());
+    heldRecv_.clear();
+    out.clear();
+
+    ULONG n = g_rio.RIODequeueCompletion(
+        recvCq_, results_.data(), static_cast<ULONG>(std::min(maxCount, recvSlots_)));
+    if (n == RIO_CORRUPT_CQ)
+    {
+        std::cerr << "RIODequeueCompletion: receive completion queue corrupt\n";
+        return 0;
+    }
+    if (n > 0)
+        recvDequeues_.store(recvDequeues_.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const RIORESULT& r = results_[i];
+        size_t idx = static_cast<size_t>(r.RequestContext);
+        heldRecv_.push_back(idx);
+        if (r.Status != 0)
+            continue;   // 数据报过长等错误：丢弃，块照样重新投递
+        RioDatagram d;
+        d.data = slot(idx);
+        d.len  = r.BytesTransferred;
+        const SOCKADDR_INET* from =
+            reinterpret_cast<const SOCKADDR_INET*>(region_ + addrOffset(idx));
+        std::memcpy(&d.from, &from->Ipv4, sizeof(d.from));
+        out.push_back(d);
+    }
+    recvsReaped_.store(recvsReaped_.load(std::memory_order_relaxed) + n,
+                       std::memory_order_relaxed);
+    return out.size();
+}
+
+
+void RioQueue::armNotify()
+{
+    if (armed_)
+        return;
+    // 完成队列中已经有完成时事件立即置位
+    int ret = g_rio.RIONotify(recvCq_);
+    armed_ = ret == 0 || ret == WSAEALREADY;
+}
@@ -0,0 +1,101 @@
+// rudp_rio.h —— Registered I/O（RIO）数据通路：预先注册的缓冲块 + 完成队列，批量提交 / 批量收割
+#pragma once
+#include "rudp.h"
+#include <windows.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+inline constexpr size_t RIO_SEND_SLOTS_PER_BATCH = 4;     // 发送块数 = 批大小的几倍（在途的提交）
+inline constexpr size_t RIO_RECV_SLOTS           = 256;   // 接收端一直投递着的接收块数
+inline constexpr int    RIO_SEND_WAIT_MS         = 1000;  // 发送块用完时最多等多久发送完成
+
+// 创建 UDP 套接字：registeredIo 时带 WSA_FLAG_REGISTERED_IO（RIO 只能用在这样创建的套接字上），
+// 失败时退回普通套接字。这样创建的套接字照常支持 sendto / recvfrom
+SOCKET openUdpSocket(bool registeredIo);
+
+// 一个收割到的数据报：data 指向注册缓冲块，下一次 recvBatch 之前有效
+struct RioDatagram
+{
+    const char* data = nullptr;
+    size_t      len  = 0;
+    sockaddr_in from{};
+};
+
+// 一个套接字上的 RIO 请求队列。缓冲块在 open 时一次分配、注册（锁定在物理内存中），
+// 之后收发路径上不再有缓冲区探测和锁页，一批请求只进一次内核：
+//   发送：分组封装进空闲发送块，除最后一个外都带 RIO_MSG_DEFER，整批一次提交；
+//         发送完成在下一批之前从完成队列收割，块放回空闲栈；块用完时睡在发送完成队列的
+//         通知事件上，RIO_SEND_WAIT_MS 内没有任何发送完成就报错
+//   接收：所有接收块一直投递着，数据报直接落进注册缓冲，一次出队取回一批完成；
+//         调用方处理完后，这些块在下一次 recvBatch 时重新投递
+// 接收完成队列绑定一个事件，armNotify 之后有新完成时置位，交给 SocketWaiter 等待。
+// 不是线程安全的，只由一个线程使用
+class RioQueue
+{
+public:
+    RioQueue() = default;
+    ~RioQueue();
+    RioQueue(const RioQueue&) = delete;
+    RioQueue& operator=(const RioQueue&) = delete;
+
+    // slotBytes：每块能放下的最大数据报；系统不支持 RIO 或套接字不是 RIO 套接字时返回 false
+    bool open(SOCKET s, size_t sendSlots, size_t recvSlots, size_t slotBytes);
+    void close();
+
+    // 发送一批分组到同一个地址（与 sendPacketBatch 一样经过模拟链路）
+    bool sendBatch(const sockaddr_in& to, const OutPacket* pkts, size_t count);
+
+    // 取回最多 maxCount 个已完成的接收（不等待），返回个数
+    size_t recvBatch(std::vector<RioDatagram>& out, size_t maxCount);
+
+    HANDLE notifyEvent() const { return notifyEvent_; }
+    void   armNotify();                   // 请求下一次接收完成时置位事件（已经请求过则不重复）
+    void   notified() { armed_ = false; } // 等待因事件置位而返回后调用
+
+    size_t   sendSlots() const { return sendSlots_; }
+    size_t   recvSlots() const { return recvSlots_; }
+    size_t   registeredBytes() const { return regionBytes_; }
+    uint64_t sendsPosted() const { return sendsPosted_; }
+    uint64_t sendCommits() const { return sendCommits_; }
+    uint64_t sendWaits() const { return sendWaits_; }
+    // 接收计数由收包线程写，汇总统计时别的线程可以读
+    uint64_t recvsReaped() const { return recvsReaped_.load(std::memory_order_relaxed); }
+    uint64_t recvDequeues() const { return recvDequeues_.load(std::memory_order_relaxed); }
+
+private:
+    char* slot(size_t idx) const { return region_ + idx * slotBytes_; }
+    size_t addrOffset(size_t idx) const;
+    bool   reapSends();
+    bool   waitSendSlot();
+    bool   commitSends();
+    bool   postRecv(size_t idx, bool defer);
+
+    SOCKET s_           = INVALID_SOCKET;
+    char*  region_      = nullptr;   // [发送块][接收块][每块一个对端地址]
+    size_t regionBytes_ = 0;
+    size_t slotBytes_   = 0;
+    size_t sendSlots_   = 0;
+    size_t recvSlots_   = 0;
+    HANDLE notifyEvent_ = nullptr;   // 接收完成队列的通知事件
+    HANDLE sendEvent_   = nullptr;   // 发送完成队列的通知事件（只在发送块用完时等待）
+    bool   armed_       = false;
+
+    RIO_BUFFERID bufferId_ = RIO_INVALID_BUFFERID;
+    RIO_CQ       sendCq_   = RIO_INVALID_CQ;
+    RIO_CQ       recvCq_   = RIO_INVALID_CQ;
+    RIO_RQ       rq_       = RIO_INVALID_RQ;
+    std::vector<RIORESULT> results_;   // 出队缓冲
+
+    std::vector<uint32_t> freeSend_;   // 空闲发送块
+    std::vector<uint32_t> heldRecv_;   // 上一批交给调用方、等待重新投递的接收块
+    size_t                deferred_ = 0;   // 已经投递、还没提交的发送
+
+    uint64_t sendsPosted_  = 0;
+    uint64_t sendCommits_  = 0;   // 提交次数（每批一次）
+    uint64_t sendWaits_    = 0;   // 发送块用完、等发送完成的次数
+    std::atomic<uint64_t> recvsReaped_{0};
+    std::atomic<uint64_t> recvDequeues_{0};   // 取到至少一个完成的出队次数
+};
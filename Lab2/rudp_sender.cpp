@@ -1,5 +1,9 @@
-// rudp_sender.cpp —— 发送端：三次握手 + 滑动窗口 + Reno + SACK + 统计
+// rudp_sender.cpp —— 发送端：三次握手 + 滑动窗口 + 拥塞控制 + SACK + 统计
 #include "rudp.h"
+#include "rudp_cc.h"
+#include "rudp_mmap.h"
+#include "rudp_hash.h"
+#include "rudp_rio.h"
 
 #include <iostream>
 #include <fstream>
@@ -8,18 +12,26 @@
 #include <chrono>
 #include <algorithm>
 #include <cstring>
-
-using Clock = std::chrono::steady_clock;
-
-// 单个发送槽
+#include <cmath>
+#include <queue>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// 单个发送槽（发送环中循环复用）
 struct SendSlot
 {
     PacketHeader hdr{};
-    std::vector<char> data;
+    char*       buf  = nullptr;  // 发送缓冲池中属于本槽位的一块（映射输入时不用）
+    const char* data = nullptr;  // 负载：指向 buf，或直接指向输入文件映射
+    uint16_t    len  = 0;        // 负载长度
 
     bool sent      = false;   // 是否发送过（任意一次）
     bool acked     = false;   // 是否已被确认
     bool firstSent = false;   // 是否已经记录 firstSendTime
+    bool retransmitted = false; // 是否被重传过（Karn 算法：不采样其 RTT）
 
     //用来计算RTT，ack收到时刻-firstSendTime
     Clock::time_point firstSendTime;
@@ -28,28 +40,260 @@ struct SendSlot
     Clock::time_point lastSendTime;
 };
 
+// 发送环缓冲块的总字节预算：槽位数取对端通告窗口，但不超过 预算 / 负载大小。
+// 默认 1000 字节负载时 65535 的最大窗口恰好放得下，大负载时窗口按字节收小。
+// 多流传输时各流平分这份预算，整个传输的发送环合计仍不超过它
+constexpr size_t SEND_RING_BYTES_MAX = 64u << 20;
+
+// RTT 估计器（Jacobson/Karels）：SRTT、RTTVAR 平滑，RTO = SRTT + 4*RTTVAR，
+// 夹在 [RTO_MIN_MS, RTO_MAX_MS] 之间，超时时指数退避，新样本到来时复位
+struct RttEstimator
+{
+    double srttUs    = 0.0;
+    double rttvarUs  = 0.0;
+    double rtoUs     = 0.0;
+    bool   hasSample = false;
+    int    backoffs  = 0;     // 当前连续退避次数
+
+    explicit RttEstimator(int initialRtoMs)
+        : rtoUs(clampRto(initialRtoMs * 1000.0))
+    {
+    }
+
+    static double clampRto(double us)
+    {
+        return std::min<double>(RTO_MAX_MS * 1000.0,
+                                std::max<double>(RTO_MIN_MS * 1000.0, us));
+    }
+
+    void onSample(double rttUs)
+    {
+        if (!hasSample)
+        {
+            srttUs    = rttUs;
+            rttvarUs  = rttUs / 2.0;
+            hasSample = true;
+        }
+        else
+        {
+            // beta = 1/4, alpha = 1/8
+            rttvarUs = 0.75 * rttvarUs + 0.25 * std::abs(srttUs - rttUs);
+            srttUs   = 0.875 * srttUs + 0.125 * rttUs;
+        }
+        backoffs = 0;
+        rtoUs    = clampRto(srttUs + std::max(1000.0, 4.0 * rttvarUs));
+    }
+
+    void onTimeout()
+    {
+        ++backoffs;
+        rtoUs = clampRto(rtoUs * 2.0);
+    }
+};
+
+// 重传定时器：按截止时间放进最小堆，只有到期的分组才会被检查。
+// 槽位被确认或重新发送后旧定时器不删除，弹出时凭 sentAt 识别为过期条目
+struct RetxTimer
+{
+    Clock::time_point deadline;
+    size_t            idx;      // 分组下标
+    Clock::time_point sentAt;   // 设定定时器时该分组的 lastSendTime
+
+    bool operator>(const RetxTimer& other) const
+    {
+        return deadline > other.deadline;
+    }
+};
+
+using RetxTimerHeap =
+    std::priority_queue<RetxTimer, std::vector<RetxTimer>, std::greater<RetxTimer>>;
+
+// 令牌桶发送节奏控制（pacing）：按速率（分组/秒）发放令牌，每个新 DATA 分组消耗一个，
+// 把一整窗的突发摊开到整个 RTT 上。桶容量取 PACING_BURST_US 内的发送量，
+// 与事件循环的 1ms 等待精度匹配，高速率下也不会被等待精度卡住
+constexpr double PACING_BURST_US   = 1000.0;
+constexpr double PACING_MIN_BURST  = 2.0;    // 桶容量下限（分组）
+constexpr double PACING_SS_GAIN    = 2.0;    // 慢启动阶段速率 = 2 * cwnd / SRTT
+constexpr double PACING_CA_GAIN    = 1.2;    // 拥塞避免阶段速率 = 1.2 * cwnd / SRTT
+
+struct Pacer
+{
+    double            rate   = 0.0;   // 分组/秒，0 表示不限速
+    double            tokens = 0.0;
+    bool              primed = false;
+    Clock::time_point lastRefill;
+
+    double burst() const
+    {
+        return std::max(PACING_MIN_BURST, rate * PACING_BURST_US / 1e6);
+    }
+
+    void refill(Clock::time_point now)
+    {
+        if (!primed)
+        {
+            primed = true;
+            tokens = burst();
+        }
+        else
+        {
+            double dt = std::chrono::duration<double>(now - lastRefill).count();
+            tokens = std::min(burst(), tokens + rate * dt);
+        }
+        lastRefill = now;
+    }
+
+    // 有令牌则消耗一个并返回 true
+    bool tryConsume(Clock::time_point now)
+    {
+        if (rate <= 0.0)
+            return true;
+        refill(now);
+        if (tokens < 1.0)
+            return false;
+        tokens -= 1.0;
+        return true;
+    }
+
+    // 下一个令牌可用的时刻
+    Clock::time_point nextRelease() const
+    {
+        double waitUs = (1.0 - tokens) / rate * 1e6;
+        return lastRefill + std::chrono::microseconds(
+                                static_cast<int64_t>(std::ceil(waitUs)));
+    }
+};
+
+// SACK 记分板：记录累计确认点之后已经处理过的 SACK 区间 [start, end]，
+// 区间互不重叠也不相邻。每个 ACK 只遍历新覆盖的序号，
+// 处理代价与新确认的分组数成正比，而不是与已交付的数据量成正比
+struct SackScoreboard
+{
+    std::map<uint32_t, uint32_t> ranges;   // start -> end
+
+    // 对 [start, end] 中还没记录过的序号逐个调用 onNew，再把区间并入记分板
+    template <typename F>
+    void add(uint32_t start, uint32_t end, F&& onNew)
+    {
+        auto it = ranges.upper_bound(start);
+        if (it != ranges.begin())
+        {
+            auto prev = std::prev(it);
+            if (prev->second + 1 >= start)   // 与前一个区间重叠或相邻
+                it = prev;
+        }
+
+        uint32_t mergedStart = start;
+        uint32_t mergedEnd   = end;
+        uint32_t cur         = start;       // [start, cur) 已经处理完
+        while (it != ranges.end() && it->first - 1 <= end)
+        {
+            for (uint32_t seq = cur; seq < it->first && seq <= end; ++seq)
+                onNew(seq);
+            cur         = std::max(cur, it->second + 1);
+            mergedStart = std::min(mergedStart, it->first);
+            mergedEnd   = std::max(mergedEnd, it->second);
+            it = ranges.erase(it);
+        }
+        for (uint32_t seq = cur; seq <= end; ++seq)
+            onNew(seq);
+
+        ranges[mergedStart] = mergedEnd;
+    }
+
+    // 累计 ACK 从 from 推进到 to：跳过记分板里已处理的区间，
+    // 只对其余序号调用 onNew，并丢弃已被累计确认覆盖的区间
+    template <typename F>
+    void advance(uint32_t from, uint32_t to, F&& onNew)
+    {
+        uint32_t seq = from;
+        auto it = ranges.begin();
+        while (seq <= to)
+        {
+            if (it != ranges.end() && it->first <= seq)
+            {
+                seq = std::max(seq, it->second + 1);
+                if (it->second <= to)
+                {
+                    it = ranges.erase(it);
+                }
+                else
+                {
+                    // 区间跨过了新的累计确认点，只保留右半部分
+                    uint32_t end = it->second;
+                    ranges.erase(it);
+                    it = ranges.emplace(to + 1, end).first;
+                }
+                continue;
+            }
+
+            uint32_t stop = (it != ranges.end() && it->first <= to)
+                                ? it->first - 1
+                                : to;
+            for (; seq <= stop; ++seq)
+                onNew(seq);
+        }
+    }
+};
+
 // ============ 三次握手（客户端） ============
 
-static bool senderHandshake(SOCKET s, const sockaddr_in& serverAddr)
+// 随机选一个非 0 的连接号
+static uint32_t newConnectionId()
+{
+    std::random_device rd;
+    std::mt19937 gen(rd() ^ static_cast<uint32_t>(
+                                 Clock::now().time_since_epoch().count()));
+    uint32_t id = 0;
+    while (id == 0)
+        id = gen();
+    return id;
+}
+
+//peerWnd 带回 SYN-ACK 中接收端通告的窗口，用于确定发送环大小
+//options 带回双方都同意的握手选项（SYN-ACK 的 reserved 与自己请求的交集）
+//payloadSize 带回接收端同意的 DATA 负载大小（没有协商时为 MAX_PAYLOAD）
+//connId：本连接的连接号，作为 SYN 的序号发出
+//stream：多流传输中的一个流时为它的流描述，随 SYN 负载发出，否则为空
+static bool senderHandshake(SOCKET s, const sockaddr_in& serverAddr, uint32_t connId,
+                            const StreamDescriptor* stream,
+                            uint16_t& peerWnd, uint8_t& options, uint16_t& payloadSize)
 {
     int dynamicTimeout = HANDSHAKE_TIMEOUT_MS + 2 * g_linkDelayMs;  // 2倍链路延迟（往返）
     setRecvTimeout(s, dynamicTimeout); 
     //设置接收超时时间
 
     PacketHeader syn{};
-    //构造一个只有SYN的包，序号从0开始
-    syn.seq   = 0;
+    //构造一个只有SYN的包，序号就是连接号
+    syn.seq   = connId;
     syn.ack   = 0;
     syn.flags = FLAG_SYN;
     syn.wnd   = static_cast<uint16_t>(g_recvWindow);
-    syn.reserved = 0;
+    syn.reserved = static_cast<uint8_t>((g_crc32c ? OPT_CRC32C : 0) |
+                                        (g_sackBitmap ? OPT_SACK_BITMAP : 0) |
+                                        (g_payloadSize > 0 ? OPT_PAYLOAD_SIZE : 0) |
+                                        (stream ? OPT_STREAM : 0));   // 请求的选项
+    // SYN 负载：[请求的负载大小][流描述]，各自只在请求了对应选项时出现
+    const uint16_t requestedPayload = static_cast<uint16_t>(g_payloadSize);
+    char     synPayload[sizeof(requestedPayload) + sizeof(StreamDescriptor)];
+    uint16_t synLen = 0;
+    if (g_payloadSize > 0)
+    {
+        std::memcpy(synPayload, &requestedPayload, sizeof(requestedPayload));
+        synLen += sizeof(requestedPayload);
+    }
+    if (stream)
+    {
+        std::memcpy(synPayload + synLen, stream, sizeof(StreamDescriptor));
+        synLen += sizeof(StreamDescriptor);
+    }
 
     const int MAX_TRY = 5;//最多MAX_TRY次重试循环
 
     for (int i = 0; i < MAX_TRY; ++i)
     {
         std::cout << "[sender] send SYN\n";
-        sendPacket(s, serverAddr, syn, nullptr, 0);
+        sendPacket(s, serverAddr, syn, synLen > 0 ? synPayload : nullptr, synLen);
 
         PacketHeader resp{};
         std::vector<char> payload;
@@ -65,9 +309,19 @@ static bool senderHandshake(SOCKET s, const sockaddr_in& serverAddr)
             if (isSynAck && resp.ack == syn.seq + 1)
             {
                 std::cout << "[sender] recv SYN-ACK\n";
+                peerWnd = resp.wnd;
+                options = resp.reserved & syn.reserved;
+                payloadSize = MAX_PAYLOAD;
+                uint16_t agreed = 0;
+                if ((options & OPT_PAYLOAD_SIZE) && payload.size() >= sizeof(agreed))
+                {
+                    std::memcpy(&agreed, payload.data(), sizeof(agreed));
+                    if (agreed >= 64 && agreed <= requestedPayload)
+                        payloadSize = agreed;
+                }
 
                 PacketHeader ack{};//构造最终ACK报文
-                ack.seq   = syn.seq + 1;
+                ack.seq   = connId;   // 纯 ACK 在 seq 字段带连接号
                 ack.ack   = resp.seq + 1;
                 ack.flags = FLAG_ACK;
                 ack.wnd   = static_cast<uint16_t>(g_recvWindow);
@@ -86,16 +340,111 @@ static bool senderHandshake(SOCKET s, const sockaddr_in& serverAddr)
     return false;
 }
 
+// ============ 路径 MTU 探测 ============
+
+// 在 [base, maxSize] 中二分查找能送达的最大负载（DPLPMTUD 的简化版，RFC 8899）：
+// 探测分组带 FLAG_PROBE 和一段全 0 负载，接收端收到后回 FLAG_ACK | FLAG_PROBE；
+// 同一大小连续 PMTU_MAX_PROBES 次没有回应就认为过大。base 是默认负载，视为一定可达。
+// 先试上限本身，回环 / 巨帧链路上一次就能确认
+//probesSent 带回发出的探测分组数
+static uint16_t probePathPayload(SOCKET s, const sockaddr_in& serverAddr, uint32_t connId,
+                                 uint16_t base, uint16_t maxSize,
+                                 uint8_t integrityFlag, uint64_t& probesSent)
+{
+    setRecvTimeout(s, PMTU_PROBE_TIMEOUT_MS + 2 * g_linkDelayMs);
+    std::vector<char> zeros(maxSize, 0);
+    uint32_t probeId = 0;
+
+    auto probe = [&](uint16_t size) -> bool
+    {
+        for (int i = 0; i < PMTU_MAX_PROBES; ++i)
+        {
+            PacketHeader ph{};
+            ph.seq   = ++probeId;
+            ph.ack   = connId;
+            ph.flags = FLAG_PROBE | integrityFlag;
+            sendPacket(s, serverAddr, ph, zeros.data(), size);
+            ++probesSent;
+
+            // 丢掉之前探测迟到的确认，只认本次的编号
+            PacketHeader resp{};
+            std::vector<char> payload;
+            sockaddr_in from{};
+            while (recvPacket(s, resp, payload, from))
+            {
+                if ((resp.flags & FLAG_PROBE) && (resp.flags & FLAG_ACK) &&
+                    resp.ack == ph.seq)
+                    return true;
+            }
+        }
+        return false;
+    };
+
+    uint16_t good = std::min(base, maxSize);
+    if (maxSize <= good || probe(maxSize))
+        return maxSize;
+
+    uint16_t bad = maxSize;
+    while (bad - good > PMTU_SEARCH_STEP)
+    {
+        uint16_t mid = static_cast<uint16_t>(good + (bad - good) / 2);
+        if (probe(mid))
+            good = mid;
+        else
+            bad = mid;
+    }
+    return good;
+}
+
+// 把探测出的负载大小告诉接收端：定位写 / 多流传输时接收端按 (seq-1) * 负载大小 计算偏移，
+// 必须在第一个 DATA 之前换成同一个值。接收端确认的大小与 size 一致才返回 true
+static bool commitProbedPayload(SOCKET s, const sockaddr_in& serverAddr, uint32_t connId,
+                                uint16_t size, uint8_t integrityFlag)
+{
+    setRecvTimeout(s, PMTU_PROBE_TIMEOUT_MS + 2 * g_linkDelayMs);
+    // 编号与探测分组不同，迟到的探测确认不会被当成本次确认
+    const uint32_t commitId = 0x80000000u;
+    for (int i = 0; i < PMTU_COMMIT_TRIES; ++i)
+    {
+        PacketHeader ch{};
+        ch.seq      = commitId;
+        ch.ack      = connId;
+        ch.flags    = FLAG_PROBE | integrityFlag;
+        ch.reserved = PROBE_COMMIT;
+        sendPacket(s, serverAddr, ch, reinterpret_cast<const char*>(&size), sizeof(size));
+
+        PacketHeader resp{};
+        std::vector<char> payload;
+        sockaddr_in from{};
+        while (recvPacket(s, resp, payload, from))
+        {
+            if ((resp.flags & FLAG_PROBE) && (resp.flags & FLAG_ACK) &&
+                resp.ack == commitId && payload.size() >= sizeof(uint16_t))
+            {
+                uint16_t applied = 0;
+                std::memcpy(&applied, payload.data(), sizeof(applied));
+                return applied == size;
+            }
+        }
+    }
+    return false;
+}
+
 // ============ 四次挥手（客户端主动关闭） ============
 
-static bool senderFourWayClose(SOCKET s, const sockaddr_in& serverAddr)
+//integrityFlag：协商了 CRC32C 时为 FLAG_CRC32C，挥手报文同样带上
+//digest：源文件摘要，放在 FIN 负载里交给接收端核对
+//peerDigest / peerHasDigest：带回接收端 FIN 中它写入数据的摘要
+static bool senderFourWayClose(SOCKET s, const sockaddr_in& serverAddr, uint32_t connId,
+                               uint8_t integrityFlag, uint64_t digest,
+                               uint64_t& peerDigest, bool& peerHasDigest)
 {
     setRecvTimeout(s, HANDSHAKE_TIMEOUT_MS);//设置接收超时时间
 
     PacketHeader fin1{};//构造第一次FIN报文
     fin1.seq   = 1;
-    fin1.ack   = 0;
-    fin1.flags = FLAG_FIN;
+    fin1.ack   = connId;
+    fin1.flags = FLAG_FIN | integrityFlag;
     fin1.wnd   = 0;
     fin1.reserved = 0;
 
@@ -105,7 +454,8 @@ static bool senderFourWayClose(SOCKET s, const sockaddr_in& serverAddr)
     {
         std::cout << "[sender] send FIN\n";//发送日志
          // sendPacket：调用公共工具函数，发送fin1包（已提前设置flags=FLAG_FIN、seq=1）
-        sendPacket(s, serverAddr, fin1, nullptr, 0);
+        sendPacket(s, serverAddr, fin1,
+                   reinterpret_cast<const char*>(&digest), FIN_DIGEST_BYTES);
 
         // 等待 ACK（第二次挥手）
         PacketHeader resp{};// 存储接收端的响应头部
@@ -134,12 +484,17 @@ static bool senderFourWayClose(SOCKET s, const sockaddr_in& serverAddr)
             if (peerFin.flags & FLAG_FIN)
             {
                 std::cout << "[sender] recv peer FIN\n";
+                if (dummy.size() >= FIN_DIGEST_BYTES)
+                {
+                    std::memcpy(&peerDigest, dummy.data(), FIN_DIGEST_BYTES);
+                    peerHasDigest = true;
+                }
 
                 // 发送最后一个 ACK（第四次挥手）
                 PacketHeader ack2{};
-                ack2.seq   = 0;
+                ack2.seq   = connId;
                 ack2.ack   = peerFin.seq + 1;
-                ack2.flags = FLAG_ACK;
+                ack2.flags = FLAG_ACK | integrityFlag;
                 ack2.wnd   = static_cast<uint16_t>(g_recvWindow);
                 ack2.reserved = 0;
 
@@ -156,10 +511,29 @@ static bool senderFourWayClose(SOCKET s, const sockaddr_in& serverAddr)
 
 // ============ 发送端主逻辑 ============
 
-void runSender(const std::string& ip, uint16_t port, const std::string& inputFile)
+// 一个连接的发送结果，多流传输时用来汇总
+struct StreamResult
+{
+    bool     ok              = false;   // 数据全部确认、挥手完成且接收端回送的摘要一致
+    bool     dataDone        = false;   // 数据全部确认
+    bool     closed          = false;   // 四次挥手完成（接收端的 FIN 带回了它的摘要）
+    bool     digestMatch     = false;   // 接收端回送的摘要与本端一致
+    uint64_t bytesDelivered  = 0;
+    uint64_t packetsSent     = 0;
+    uint64_t retransmissions = 0;
+    Clock::time_point startTime, endTime;
+};
+
+// 多流传输时几个发送线程的统计输出到同一个 stdout：整段统计在锁内输出，不穿插
+static std::mutex g_statsMutex;
+
+// 一个连接：握手、发送文件（多流传输时只发 stream 描述的字节范围）、挥手、输出统计。
+// 每个连接有自己的套接字、发送环和拥塞控制器，互不共享状态
+static void sendStream(const std::string& ip, uint16_t port, const std::string& inputFile,
+                       const StreamDescriptor* stream, StreamResult& result)
 {
     //建立UDP Socket
-    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    SOCKET s = openUdpSocket(g_registeredIo);
     if (s == INVALID_SOCKET)
     {
         printLastError("socket");
@@ -171,63 +545,92 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
     server.sin_port        = htons(port);
     server.sin_addr.s_addr = inet_addr(ip.c_str());
 
-    //三次握手
-    if (!senderHandshake(s, server))
+    //三次握手：连接号让接收端在同一端口上区分不同的连接（包括同一地址先后发起的连接）
+    const uint32_t connId = newConnectionId();
+    uint16_t synAckWnd = 0;
+    uint8_t  options   = 0;
+    uint16_t payloadSize = MAX_PAYLOAD;
+    if (!senderHandshake(s, server, connId, stream, synAckWnd, options, payloadSize))
     {
         closesocket(s);
         return;
     }
-    //打开待发送文件
-    std::ifstream fin(inputFile, std::ios::binary);
-    if (!fin)
+    if (stream && !(options & OPT_STREAM))
     {
-        std::cerr << "[sender] open input file failed\n";
+        std::cerr << "[sender] peer declined multi-stream transfer\n";
         closesocket(s);
         return;
     }
-
-    // 把文件切分成多个数据分组
-    std::vector<SendSlot> slots;
-    //每次最多读出MAX_PAYLOAD字节,构造一个SendSlot，放入slots
-    char buffer[MAX_PAYLOAD];
-    uint32_t seq = 1;                // 数据起始序号（与握手分开）
-
-    while (true)
+    // 完整性校验：协商成功后握手之后的所有分组都带 CRC32C 扩展头部
+    const uint8_t integrityFlag = (options & OPT_CRC32C) ? FLAG_CRC32C : 0;
+    if (g_crc32c && !integrityFlag)
+        std::cout << "[sender] peer declined CRC32C, using 16-bit checksum\n";
+    // 位图 SACK：ACK 报告窗口内每个分组的接收情况，发送端据此把空洞逐个重传
+    const bool bitmapSack = (options & OPT_SACK_BITMAP) != 0;
+    if (g_sackBitmap && !bitmapSack)
+        std::cout << "[sender] peer declined bitmap SACK, using SACK blocks\n";
+
+    // 负载大小：握手协商出的上限，--pmtu-probe 时再按路径实际能送达的大小收小
+    const uint16_t negotiatedPayload = payloadSize;
+    uint64_t probesSent = 0;
+    if (g_pmtuProbe && payloadSize > MAX_PAYLOAD)
     {
-        fin.read(buffer, MAX_PAYLOAD);
-        std::streamsize n = fin.gcount();
-        if (n <= 0)
-            break;
-
-        SendSlot slot;
-        slot.hdr.seq   = seq++;
-        slot.hdr.ack   = 0;
-        slot.hdr.flags = FLAG_DATA;
-        slot.hdr.wnd   = 0;
-        slot.hdr.reserved = 0;
-        slot.data.assign(buffer, buffer + n);
-        slots.push_back(std::move(slot));
+        if (!setDontFragment(s, true))
+            std::cout << "[sender] DF bit unavailable, probes may be fragmented\n";
+        payloadSize = probePathPayload(s, server, connId, MAX_PAYLOAD, payloadSize,
+                                       integrityFlag, probesSent);
+        std::cout << "[sender] path MTU probe: payload " << payloadSize
+                  << " bytes (" << probesSent << " probes)\n";
+        // 接收端的定位写偏移按负载大小计算，收小之后要先让它换成同一个值
+        if (payloadSize != negotiatedPayload &&
+            !commitProbedPayload(s, server, connId, payloadSize, integrityFlag))
+        {
+            std::cerr << "[sender] receiver did not confirm the probed payload size\n";
+            closesocket(s);
+            return;
+        }
     }
-    fin.close();
-    //空文件处理
-    if (slots.empty())
+    if (payloadSize != MAX_PAYLOAD)
+        std::cout << "[sender] using " << payloadSize << "-byte payloads\n";
+    const size_t packetBytes = headerBytes(integrityFlag) + payloadSize;
+    //打开待发送文件：默认流式读入发送环，--mmap 时整个文件只读映射
+    std::ifstream fin;
+    MappedFile    mapped;
+    bool openOk = g_mmapInput ? mapped.open(inputFile)
+                              : (fin.open(inputFile, std::ios::binary), fin.is_open());
+    if (!openOk)
     {
-        std::cout << "[sender] input file empty, nothing to send\n";
-        senderFourWayClose(s, server);
+        std::cerr << "[sender] open input file failed\n";
         closesocket(s);
         return;
     }
-
+    // 本连接负责的字节范围：单连接时是整个文件。范围长度事先知道，
+    // 读满之后立即判定文件结束，不必再多读一次空块
+    const uint64_t rangeBegin = stream ? stream->offset : 0;
+    uint64_t       rangeLeft  = 0;   // 还没读入的字节数
+    if (stream)
+        rangeLeft = stream->length;
+    else if (g_mmapInput)
+        rangeLeft = mapped.size();
+    else
+    {
+        fin.seekg(0, std::ios::end);
+        rangeLeft = static_cast<uint64_t>(std::max<std::streamoff>(fin.tellg(), 0));
+        fin.seekg(0, std::ios::beg);
+    }
+    if (!g_mmapInput && rangeBegin > 0)
+        fin.seekg(static_cast<std::streamoff>(rangeBegin));
 
     const uint32_t firstDataSeq = 1;//数据序号从1开始
 
-    // 拥塞控制：简化 Reno
-    double cwnd     = 1.0;   // 拥塞窗口（单位：分组）
-    double ssthresh = 16.0;//慢启动阈值
+    // 拥塞控制：算法由 --cc 选择，默认 Reno；窗口上限只受对端通告窗口约束
+    std::unique_ptr<CongestionController> cc =
+        makeCongestionController(g_congestionControl);
 
-    uint16_t peerWnd = static_cast<uint16_t>(g_recvWindow); // 对端通告窗口（初值）
+    // 对端通告窗口（初值取 SYN-ACK 中的通告）
+    uint16_t peerWnd = (synAckWnd == 0 ? 1 : synAckWnd);
 
-    // Reno 所需的额外状态：用于实现快速重传 / 快速恢复
+    // 快速重传 / 快速恢复的额外状态
     uint32_t lastAckSeq   = firstDataSeq - 1; // 最近一次累计 ACK 的序号
     int      dupAckCount  = 0;                // 连续重复 ACK 次数
     bool     inFastRecovery = false;          // 是否处于快速恢复阶段
@@ -236,6 +639,104 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
     size_t base = 0;    // 当前窗口中最早未确认分组下标
     size_t next = 0;    // 下一个待发送分组下标
 
+    // 发送环：不再预先把整个文件切成分组，只保留窗口内的分组，
+    // 槽位按 下标 % ringCap 循环复用，随 base 前移从文件补充，
+    // 内存占用与文件大小无关
+    // 发送窗口不会超过对端通告窗口，也不会超过发送环：环满时新分组等确认腾出槽位
+    const size_t ringBudget = SEND_RING_BYTES_MAX / (stream ? stream->count : 1);
+    const size_t ringCap = std::max<size_t>(
+        1, std::min<size_t>(peerWnd, ringBudget / payloadSize));
+    if (ringCap < peerWnd)
+        std::cout << "[sender] send ring clamped to " << ringCap << " slots ("
+                  << (ringBudget >> 10) << " KB budget, peer window " << peerWnd << ")\n";
+    std::vector<SendSlot> ring(ringCap);
+    // 每个槽位固定占用缓冲池中的一块：文件直接读进去，发送时原地校验、聚集发出；
+    // 映射输入时负载直接引用映射，不需要缓冲块
+    PacketPool ringPool(payloadSize, g_mmapInput ? 0 : ringCap);
+    if (!g_mmapInput)
+        for (SendSlot& slot : ring)
+            slot.buf = ringPool.acquire();
+    size_t loaded = 0;      // 已从文件读入的分组数（下标 < loaded 的分组有效）
+    bool   fileEof = false; // 文件是否已读完
+
+    // 端到端文件摘要：分组按序装入发送环时顺带计算，数据只经过一次；
+    // 挥手时放进 FIN 交给接收端核对
+    Xxh64    fileHash;
+    uint64_t hashNs = 0;
+
+    auto slotAt = [&](size_t idx) -> SendSlot& { return ring[idx % ringCap]; };
+
+    //把已确认腾出的槽位用后续文件内容补满，每次最多读出payloadSize字节
+    auto refill = [&]()
+    {
+        while (!fileEof && loaded - base < ringCap)
+        {
+            SendSlot& slot = slotAt(loaded);
+            std::streamsize n = 0;
+            if (g_mmapInput)
+            {
+                // 分组 loaded 的负载就是映射中 loaded * payloadSize 处的一段；
+                // 提前一个发送环的距离预读，发送时不在缺页上等待
+                uint64_t offset = rangeBegin + static_cast<uint64_t>(loaded) * payloadSize;
+                uint64_t remain = mapped.size() > offset ? mapped.size() - offset : 0;
+                n = static_cast<std::streamsize>(
+                    std::min<uint64_t>(std::min<uint64_t>(remain, rangeLeft), payloadSize));
+                slot.data = mapped.data() + offset;
+                mapped.prefetch(offset,
+                                std::max<uint64_t>(MMAP_PREFETCH_BYTES,
+                                                   2ull * ringCap * payloadSize));
+            }
+            else
+            {
+                fin.read(slot.buf, static_cast<std::streamsize>(
+                                       std::min<uint64_t>(rangeLeft, payloadSize)));
+                n = fin.gcount();
+                slot.data = slot.buf;
+            }
+            rangeLeft -= static_cast<uint64_t>(std::max<std::streamsize>(n, 0));
+            // 范围读完就是最后一个分组：长度恰为负载整数倍时，末组的校验分组也能跟着发出
+            if (n < payloadSize || rangeLeft == 0)
+                fileEof = true;
+            if (n <= 0)
+                break;
+
+            auto hashStart = Clock::now();
+            fileHash.update(slot.data, static_cast<size_t>(n));
+            hashNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - hashStart).count());
+
+            slot.len          = static_cast<uint16_t>(n);
+            slot.hdr          = PacketHeader{};
+            slot.hdr.seq      = firstDataSeq + static_cast<uint32_t>(loaded);
+            slot.hdr.ack      = connId;   // 连接号
+            slot.hdr.flags    = FLAG_DATA | integrityFlag;
+            slot.hdr.wnd      = 0;
+            slot.hdr.reserved = static_cast<uint8_t>(g_fecGroup);   // 前向纠错分组大小
+            slot.sent      = false;
+            slot.acked     = false;
+            slot.firstSent = false;
+            slot.retransmitted = false;
+            ++loaded;
+        }
+    };
+
+    refill();
+    //空文件处理
+    if (loaded == 0)
+    {
+        std::cout << "[sender] input file empty, nothing to send\n";
+        uint64_t peerDigest = 0;
+        bool     peerHasDigest = false;
+        result.dataDone    = true;
+        result.closed      = senderFourWayClose(s, server, connId, integrityFlag,
+                                                fileHash.digest(), peerDigest, peerHasDigest);
+        result.digestMatch = peerHasDigest && peerDigest == fileHash.digest();
+        result.ok          = result.closed && result.digestMatch;
+        closesocket(s);
+        return;
+    }
+
     // 统计信息
     bool started = false;
     Clock::time_point startTime, endTime;
@@ -245,24 +746,203 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
     uint64_t retransmissions  = 0;   // DATA 重传次数
     uint64_t rttSumUs        = 0;   // RTT 总和（微秒）
     uint64_t rttSamples       = 0;   // RTT 样本数
+    uint64_t karnSkipped      = 0;   // 因重传而丢弃的 RTT 样本数（Karn 算法）
+    uint64_t rtoTimeouts      = 0;   // 超时事件数（每个事件只退避、减窗一次）
+
+    RttEstimator rtt(g_dataTimeoutMs);
+    Clock::time_point lastRtoCut = Clock::time_point::min();  // 最近一次超时减窗的时刻
+
+    // ACK 处理代价：每个 ACK 检查的槽位数，应保持在 O(窗口) 量级
+    uint64_t acksProcessed    = 0;   // 处理过的 ACK 数
+    uint64_t slotsExamined    = 0;   // 累计检查过的槽位数
+    uint64_t maxSlotsPerAck   = 0;   // 单个 ACK 检查槽位数的最大值
+
+    uint32_t cumAckedSeq = firstDataSeq - 1;   // 已处理到的累计确认序号
+    SackScoreboard sackBoard;
+
+    // 位图 SACK 的空洞重传：highSackSeq 之前、且其后已有 SACK_DUP_THRESH 个分组到达的
+    // 未确认分组判定为丢失；holeScanSeq 之前的序号已经判定过，每个序号只检查一次
+    uint32_t highSackSeq     = firstDataSeq - 1;   // SACK 报告过的最高序号
+    uint32_t holeScanSeq     = firstDataSeq - 1;   // 已做过丢失判定的最高序号
+    uint64_t holeRetransmits = 0;                  // 按空洞重传的分组数
+    uint64_t holeRearms      = 0;                  // 空洞重传又丢失、再次按空洞重传的次数
+
+    // 已按空洞重传、尚未确认的分组，按重传时间排序。重传之后又发出的分组里已有
+    // SACK_DUP_THRESH 个被 SACK 报告，或重传已过去约一个 SRTT 仍未确认，就认为
+    // 重传本身也丢了，再重传一次，而不是等 RTO
+    struct HoleRetx
+    {
+        uint32_t          seq;
+        uint32_t          sentMark;   // 重传时已发出的最高序号
+        Clock::time_point sentAt;
+    };
+    std::deque<HoleRetx> holeRetxQueue;
+
+    // 重传定时器堆：每次发送（含重传）压入一个截止时间
+    RetxTimerHeap timers;
+    uint64_t timersFired = 0;   // 到期并触发重传的定时器数
+    uint64_t timersStale = 0;   // 弹出时已失效（已确认 / 已重发）的定时器数
+
+    auto currentRto = [&]()
+    {
+        return std::chrono::microseconds(static_cast<int64_t>(rtt.rtoUs));
+    };
+    auto armTimer = [&](size_t idx, Clock::time_point sentAt)
+    {
+        timers.push(RetxTimer{sentAt + currentRto(), idx, sentAt});
+    };
+    auto timerStale = [&](const RetxTimer& t)
+    {
+        if (t.idx < base)
+            return true;
+        const SendSlot& slot = slotAt(t.idx);
+        return slot.acked || slot.lastSendTime != t.sentAt;
+    };
+
+    // 批量收发：新分组和超时重传按批提交，ACK 每次唤醒一次取完
+    const size_t batchLimit = static_cast<size_t>(g_ioBatchSize);
+    // 发送缓冲区至少能放下两批协商长度的分组，大负载时一批不会被 sendto 卡住
+    int socketSendBuffer = growSocketBuffer(s, SO_SNDBUF, 2 * batchLimit * packetBytes);
+    std::vector<OutPacket> txBatch;
+    txBatch.reserve(batchLimit);
+    RecvBatch rxBatch(batchLimit, MAX_PACKET_BYTES);   // 只收 ACK，默认分组长度足够
+    uint64_t txBatches = 0, txBatchedPackets = 0;   // 发送批次数 / 批内分组总数
+    uint64_t rxBatches = 0, rxBatchedPackets = 0;   // 接收批次数 / 批内分组总数
+
+    auto queueSlot = [&](const SendSlot& slot)
+    {
+        txBatch.push_back(OutPacket{slot.hdr, slot.data, slot.len});
+    };
+    // Registered I/O：DATA / 校验分组封装进预先注册的发送块，整批一次提交。
+    // ACK 仍用 recvfrom 收：挥手阶段要用 recvfrom 收对端的 FIN，投递出去的 RIO 接收无法撤回
+    std::unique_ptr<RioQueue> rio;
+    if (g_registeredIo)
+    {
+        rio = std::make_unique<RioQueue>();
+        if (rio->open(s, RIO_SEND_SLOTS_PER_BATCH * batchLimit, 0, packetBytes))
+        {
+            std::cout << "[sender] registered I/O enabled, " << rio->sendSlots()
+                      << " send slots\n";
+        }
+        else
+        {
+            rio.reset();
+            std::cout << "[sender] registered I/O unavailable, fallback to plain send\n";
+        }
+    }
 
-    setRecvTimeout(s, 10);   // 数据阶段：短超时轮询
+    // UDP 分段卸载：DATA 分段大小固定为 线上头部 + payloadSize，不支持时回退到逐个 sendto；
+    // 负载大到一个超级缓冲区放不下两段时卸载没有意义，直接逐个发送
+    uint16_t offloadSegment = 0;
+    size_t   sendCalls      = 0;   // 实际调用 sendto 的次数
+    if (g_udpOffload && rio)
+    {
+        std::cout << "[sender] UDP send offload skipped, data goes through registered I/O\n";
+    }
+    else if (g_udpOffload && 2 * packetBytes > MAX_OFFLOAD_BYTES)
+    {
+        std::cout << "[sender] payload too large to coalesce, UDP send offload skipped\n";
+    }
+    else if (g_udpOffload)
+    {
+        uint16_t seg = static_cast<uint16_t>(packetBytes);
+        if (enableSendOffload(s, seg))
+        {
+            offloadSegment = seg;
+            std::cout << "[sender] UDP send offload enabled, segment=" << seg << "\n";
+        }
+        else
+        {
+            std::cout << "[sender] UDP send offload unavailable, fallback to plain send\n";
+        }
+    }
 
-    while (base < slots.size())//整个循环知道所有分组被确认为止
+    // 前向纠错：新分组首次发送时异或进当前组的校验缓冲，组满（或文件最后一个分组）
+    // 就把校验分组排进同一批发出。校验分组不重传、不占窗口。
+    // 一批最多 batchLimit 个分组，校验缓冲轮流使用 batchLimit + 1 块，批内引用的块不会被覆盖
+    const uint32_t fecGroup = static_cast<uint32_t>(g_fecGroup);
+    std::vector<char> parityRing(fecGroup > 0 ? (batchLimit + 1) * payloadSize : 0, 0);
+    size_t   parityCur    = 0;   // 正在累加的校验缓冲
+    uint16_t parityLen    = 0;   // 本组最长负载
+    uint16_t parityLenXor = 0;   // 本组负载长度的异或
+    uint64_t paritySent   = 0;
+
+    auto flushTx = [&]() -> bool
+    {
+        if (txBatch.empty())
+            return true;
+        ++txBatches;
+        txBatchedPackets += txBatch.size();
+        bool ok = rio ? rio->sendBatch(server, txBatch.data(), txBatch.size())
+                      : sendPacketBatch(s, server, txBatch.data(), txBatch.size(),
+                                        offloadSegment, &sendCalls);
+        txBatch.clear();
+        return ok;
+    };
+
+    // 数据阶段使用非阻塞套接字：睡到 ACK 到达或下一个截止时刻，醒来后把排队的 ACK 一次取完
+    auto waiter = std::make_unique<SocketWaiter>(s);
+
+    // 发送节奏控制：速率优先取拥塞控制器给出的值，否则按 cwnd / SRTT 推算
+    Pacer pacer;
+    bool  pacingHeld = false;            // 当前是否有新分组因为没有令牌而被推迟
+    Clock::time_point pacingHoldStart;
+    uint64_t pacingHolds   = 0;          // 被推迟的次数
+    uint64_t pacingDelayUs = 0;          // 新分组因 pacing 累计推迟的时间
+    double   pacingRateSum = 0.0;        // 用于统计平均速率
+    uint64_t pacingRateSamples = 0;
+
+    while (base < loaded)//整个循环直到所有分组被确认为止（环会随 base 前移不断补充）
     {
         // 发送新的分组（窗口 = min（拥塞窗口cwnd, 对端通告窗口peerWnd, 未确认分组数））
         int windowLimit = static_cast<int>(
             std::min<double>(
-                cwnd,
+                cc->cwnd(),
                 std::min<double>(peerWnd,
-                                 static_cast<double>(slots.size() - base))));
+                                 static_cast<double>(loaded - base))));
+
+        pacer.rate = 0.0;
+        if (g_pacingEnabled)
+        {
+            pacer.rate = cc->pacingRate();
+            if (pacer.rate <= 0.0 && rtt.hasSample)
+            {
+                double gain = (cc->cwnd() < cc->ssthresh()) ? PACING_SS_GAIN
+                                                            : PACING_CA_GAIN;
+                pacer.rate = gain * cc->cwnd() / (rtt.srttUs / 1e6);
+            }
+            if (pacer.rate > 0.0)
+            {
+                pacingRateSum += pacer.rate;
+                ++pacingRateSamples;
+            }
+        }
 
-        while (next < slots.size() &&
+        while (next < loaded &&
                static_cast<int>(next - base) < windowLimit)
         {
-            SendSlot& slot = slots[next];
+            SendSlot& slot = slotAt(next);
             auto now = Clock::now();
 
+            // 没有令牌：本轮不再发新分组，事件循环睡到下一个令牌可用
+            if (!pacer.tryConsume(now))
+            {
+                if (!pacingHeld)
+                {
+                    pacingHeld      = true;
+                    pacingHoldStart = now;
+                    ++pacingHolds;
+                }
+                break;
+            }
+            if (pacingHeld)
+            {
+                pacingHeld = false;
+                pacingDelayUs += static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - pacingHoldStart).count());
+            }
+
             if (!slot.firstSent)
             {
                 slot.firstSent   = true;
@@ -277,36 +957,102 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
 
             slot.lastSendTime = now;
             slot.sent         = true;
+            armTimer(next, now);
 
-            if (!sendPacket(s, server,
-                            slot.hdr,
-                            slot.data.data(),
-                            static_cast<uint16_t>(slot.data.size())))
+            queueSlot(slot);
+            if (txBatch.size() >= batchLimit && !flushTx())
             {
                 // 发送出错直接退出
                 closesocket(s);
                 return;
             }
 
+            if (fecGroup > 0)
+            {
+                char* parity = &parityRing[parityCur * payloadSize];
+                xorBytes(parity, slot.data, slot.len);
+                parityLen     = std::max(parityLen, slot.len);
+                parityLenXor ^= slot.len;
+
+                const uint32_t posInGroup = (slot.hdr.seq - firstDataSeq) % fecGroup;
+                const bool lastPacket = fileEof && next + 1 == loaded;
+                if (posInGroup + 1 == fecGroup || lastPacket)
+                {
+                    PacketHeader ph{};
+                    ph.seq      = slot.hdr.seq - posInGroup;
+                    ph.ack      = connId;
+                    ph.flags    = FLAG_FEC | integrityFlag;
+                    ph.wnd      = parityLenXor;
+                    ph.reserved = static_cast<uint8_t>(posInGroup + 1);
+                    txBatch.push_back(OutPacket{ph, parity, parityLen});
+                    ++paritySent;
+                    if (txBatch.size() >= batchLimit && !flushTx())
+                    {
+                        closesocket(s);
+                        return;
+                    }
+
+                    parityCur = (parityCur + 1) % (batchLimit + 1);
+                    std::memset(&parityRing[parityCur * payloadSize], 0, payloadSize);
+                    parityLen    = 0;
+                    parityLenXor = 0;
+                }
+            }
+
             ++totalPacketsSent;
             ++next;
         }
+        if (!flushTx())
+        {
+            closesocket(s);
+            return;
+        }
 
-        // 接收 ACK + SACK
-        PacketHeader ackHdr{};
-        std::vector<char> ackPayload;
-        sockaddr_in from{};
+        // 事件循环只睡到最早的重传截止时间 / 下一个 pacing 令牌（或 ACK 到达），
+        // 截止时刻精确到定时器精度，不再向上取整到毫秒
+        while (!timers.empty() && timerStale(timers.top()))
+        {
+            timers.pop();
+            ++timersStale;
+        }
+        // 没有在途分组时的兜底等待
+        Clock::time_point wakeAt =
+            Clock::now() + std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS);
+        if (!timers.empty())
+            wakeAt = std::min(wakeAt, timers.top().deadline);
+        if (pacingHeld)
+            wakeAt = std::min(wakeAt, pacer.nextRelease());
+
+        // 接收 ACK + SACK：本次唤醒时已经到达的 ACK 一次取完
+        size_t got = 0;
+        if (waiter->wait(wakeAt))
+        {
+            got = recvPacketBatch(s, rxBatch, batchLimit);
+            if (got > 0)
+            {
+                ++rxBatches;
+                rxBatchedPackets += got;
+            }
+        }
 
-        if (recvPacket(s, ackHdr, ackPayload, from))//成功接收ACK
+        for (size_t r = 0; r < got; ++r)//逐个处理本批 ACK
         {
-            if (ackHdr.flags & FLAG_ACK) // 仅处理 ACK 类型的包
+            const PacketHeader& ackHdr     = rxBatch.items[r].hdr;
+            const char*         ackPayload = rxBatch.items[r].payload;
+            const size_t        ackLen     = rxBatch.items[r].payloadLen;
+
+            // 仅处理 ACK 类型的包（迟到的路径 MTU 探测确认不算）
+            if ((ackHdr.flags & FLAG_ACK) && !(ackHdr.flags & FLAG_PROBE))
             {   // 更新接收端通告窗口（0 时设为 1，避免窗口为 0 导致阻塞）
                 //防止对端通告为0的时候直接卡住
                 peerWnd = (ackHdr.wnd == 0 ? 1 : ackHdr.wnd);
 
                 bool anyNewAck = false;
+                uint32_t ackedNow = 0;   // 本 ACK 新确认的分组数
+                uint64_t examined = 0;   // 本 ACK 检查过的槽位数
+                int64_t  ackRttUs = -1;  // 本 ACK 的 RTT 样本（取新确认的未重传分组中最小的）
                 auto now = Clock::now();
-                // 处理累计 ACK（Reno 部分）
+                // 处理累计 ACK：重复 ACK 计数、快速重传 / 快速恢复
                 if (ackHdr.ack >= firstDataSeq)//ACK前进
                 {
                     if (ackHdr.ack > lastAckSeq)
@@ -318,9 +1064,7 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
                         if (inFastRecovery && ackHdr.ack > recoverSeq)
                         {
                             inFastRecovery = false;
-                            cwnd           = ssthresh;
-                            if (cwnd > 64.0)
-                                cwnd = 64.0;
+                            cc->onRecoveryExit();
                         }
                     }//ACK未前进
                     else if (ackHdr.ack == lastAckSeq)
@@ -328,28 +1072,30 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
                         ++dupAckCount;
 
                         // 进入快速重传：累计 ACK 重复 3 次且仍有未确认分组
-                        if (!inFastRecovery && dupAckCount >= 3 && base < slots.size())
+                        // 位图 SACK 下丢失由空洞判定负责，不再只重传窗口第一个分组；
+                        // 开启前向纠错时多等一组，给接收端用校验分组还原的机会
+                        if (!bitmapSack && !inFastRecovery &&
+                            dupAckCount >= 3 + static_cast<int>(fecGroup) && base < loaded)
                         {
                             size_t lossIdx = base;
-                            if (lossIdx < slots.size() &&
-                                slots[lossIdx].sent && !slots[lossIdx].acked)
+                            SendSlot& lossSlot = slotAt(lossIdx);
+                            if (lossSlot.sent && !lossSlot.acked)
                             {
-                                // 退避并设置窗口到 ssthresh+3，立即重传推测丢失的分组
-                                ssthresh = (cwnd / 2.0 < 2.0) ? 2.0 : (cwnd / 2.0);
-                                cwnd     = ssthresh + 3.0;
-                                if (cwnd > 64.0)
-                                    cwnd = 64.0;
+                                // 通知拥塞控制器减窗，立即重传推测丢失的分组
+                                cc->onLoss(now);
                                 inFastRecovery = true;
                                 if (next > 0)
-                                    recoverSeq = slots[next - 1].hdr.seq;
+                                    recoverSeq = slotAt(next - 1).hdr.seq;
                                 else
-                                    recoverSeq = slots[lossIdx].hdr.seq;
+                                    recoverSeq = lossSlot.hdr.seq;
 
-                                slots[lossIdx].lastSendTime = now;
+                                lossSlot.lastSendTime  = now;
+                                lossSlot.retransmitted = true;
+                                armTimer(lossIdx, now);
                                 if (!sendPacket(s, server,
-                                                slots[lossIdx].hdr,
-                                                slots[lossIdx].data.data(),
-                                                static_cast<uint16_t>(slots[lossIdx].data.size())))
+                                                lossSlot.hdr,
+                                                lossSlot.data,
+                                                lossSlot.len))
                                 {
                                     closesocket(s);
                                     return;
@@ -361,10 +1107,7 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
                         }
                         else if (inFastRecovery)
                         {
-                            // 快速恢复阶段：每个重复 ACK 线性增大 cwnd
-                            cwnd += 1.0;
-                            if (cwnd > 64.0)
-                                cwnd = 64.0;
+                            cc->onDupAck();
                         }
                     }
                     else
@@ -376,15 +1119,18 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
                 //工具函数：标记某个分组已被确认
                 auto markIndexAcked = [&](size_t idx)
                 {
-                    if (idx >= slots.size())
+                    ++examined;
+                    // base 之前的槽位已确认并被复用，loaded 之后的还未读入
+                    if (idx < base || idx >= loaded)
                         return;
-                    SendSlot& slot = slots[idx];
+                    SendSlot& slot = slotAt(idx);
                     if (!slot.acked)
                     {
                         slot.acked = true;
                         anyNewAck  = true;
+                        ++ackedNow;
                         //记录成功交付字节数
-                        bytesDelivered += slot.data.size();
+                        bytesDelivered += slot.len;
 
                         if (slot.firstSent)
                         {
@@ -398,137 +1144,313 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
                             {
                                 rttSumUs += static_cast<uint64_t>(rttUs);
                                 ++rttSamples;
+
+                                // Karn 算法：重传过的分组无法区分是哪一次发送被确认，不参与 RTO 估计
+                                if (slot.retransmitted)
+                                    ++karnSkipped;
+                                else if (ackRttUs < 0 || rttUs < ackRttUs)
+                                    ackRttUs = rttUs;
                             }
                         }
                     }
 
                 };
 
-                // 累计确认：从 firstDataSeq 到 ackHdr.ack
-                //ackHdr.ack表示这个序号之前的所有分组都已经收到
-                if (ackHdr.ack >= firstDataSeq)
+                auto markSeqAcked = [&](uint32_t seqNum)
+                {
+                    markIndexAcked(static_cast<size_t>(seqNum - firstDataSeq));
+                };
+
+                // 累计确认：ackHdr.ack表示这个序号之前的所有分组都已经收到
+                // 只处理 (cumAckedSeq, ackHdr.ack] 这一段新覆盖的序号
                 {
-                    //映射成下标，逐个调用MarkIndexAcked
                     uint32_t maxAckSeq =
                         std::min<uint32_t>(
                             ackHdr.ack,
-                            firstDataSeq + static_cast<uint32_t>(slots.size()) - 1);
+                            firstDataSeq + static_cast<uint32_t>(loaded) - 1);
 
-                    for (uint32_t seqNum = firstDataSeq;
-                         seqNum <= maxAckSeq; ++seqNum)
+                    if (maxAckSeq > cumAckedSeq)
                     {
-                        size_t idx = static_cast<size_t>(seqNum - firstDataSeq);
-                        markIndexAcked(idx);
+                        sackBoard.advance(cumAckedSeq + 1, maxAckSeq, markSeqAcked);
+                        cumAckedSeq = maxAckSeq;
                     }
                 }
 
+                const uint32_t lastLoadedSeq =
+                    firstDataSeq + static_cast<uint32_t>(loaded) - 1;
+                if (ackHdr.flags & FLAG_SACK_BITMAP)
+                {
+                    // 解析位图 SACK：第 i 位对应 ackHdr.ack + 1 + i，连续的 1 合并成区间交给记分板
+                    uint16_t bitCount = 0;
+                    if (ackLen >= sizeof(uint16_t))
+                        std::memcpy(&bitCount, ackPayload, sizeof(uint16_t));
+                    bitCount = static_cast<uint16_t>(std::min<size_t>(
+                        bitCount, (ackLen - std::min<size_t>(ackLen, sizeof(uint16_t))) * 8));
+                    const uint8_t* bitmap =
+                        reinterpret_cast<const uint8_t*>(ackPayload + sizeof(uint16_t));
+
+                    auto bitSet = [&](size_t i)
+                    {
+                        return (bitmap[i / 8] >> (i % 8)) & 1;
+                    };
+                    size_t i = 0;
+                    while (i < bitCount)
+                    {
+                        if (bitmap[i / 8] == 0 && i % 8 == 0)
+                        {
+                            i += 8;   // 整字节没有收到的分组，跳过
+                            continue;
+                        }
+                        if (!bitSet(i))
+                        {
+                            ++i;
+                            continue;
+                        }
+                        size_t runEnd = i;
+                        while (runEnd + 1 < bitCount && bitSet(runEnd + 1))
+                            ++runEnd;
+
+                        uint32_t start = std::max<uint32_t>(
+                            ackHdr.ack + 1 + static_cast<uint32_t>(i), cumAckedSeq + 1);
+                        uint32_t end   = std::min<uint32_t>(
+                            ackHdr.ack + 1 + static_cast<uint32_t>(runEnd), lastLoadedSeq);
+                        if (start <= end)
+                        {
+                            sackBoard.add(start, end, markSeqAcked);
+                            highSackSeq = std::max(highSackSeq, end);
+                        }
+                        i = runEnd + 1;
+                    }
+                }
                 // 解析 SACK block（选择确认）
-                if (ackPayload.size() >= sizeof(uint16_t))
+                else if (ackLen >= sizeof(uint16_t))
                 {
                     uint16_t blkCount = 0;
-                    std::memcpy(&blkCount, ackPayload.data(), sizeof(uint16_t));
+                    std::memcpy(&blkCount, ackPayload, sizeof(uint16_t));
                     blkCount = std::min<uint16_t>(blkCount, MAX_SACK_BLOCKS);
 
                     size_t offset = sizeof(uint16_t);
                     for (uint16_t i = 0; i < blkCount; ++i)
                     {
-                        if (offset + sizeof(SackBlock) > ackPayload.size())
+                        if (offset + sizeof(SackBlock) > ackLen)
                             break;
 
                         SackBlock blk{};
                         std::memcpy(&blk,
-                                    ackPayload.data() + offset,
+                                    ackPayload + offset,
                                     sizeof(SackBlock));
                         offset += sizeof(SackBlock);
 
                         uint32_t start = std::max<uint32_t>(
-                            blk.start, firstDataSeq);
-                        uint32_t end   = std::min<uint32_t>(
-                            blk.end,
-                            firstDataSeq +
-                                static_cast<uint32_t>(slots.size()) - 1);
+                            blk.start, cumAckedSeq + 1);
+                        uint32_t end   = std::min<uint32_t>(blk.end, lastLoadedSeq);
 
                         if (end < start)
                             continue;
 
-                        for (uint32_t seqNum = start; seqNum <= end; ++seqNum)
+                        // 只处理区间中记分板尚未覆盖的部分
+                        sackBoard.add(start, end, markSeqAcked);
+                    }
+                }
+
+                // 位图 SACK：把新判定为丢失的空洞逐个重传，而不是等它们各自超时
+                if (bitmapSack && highSackSeq >= firstDataSeq + SACK_DUP_THRESH)
+                {
+                    uint32_t lossEdge = std::min<uint32_t>(
+                        highSackSeq - SACK_DUP_THRESH,
+                        firstDataSeq + static_cast<uint32_t>(next) - 1);
+                    // 前向纠错：校验分组跟在组尾之后，整组之后又到了 SACK_DUP_THRESH 个分组
+                    // 还没补上的空洞才算丢失
+                    if (fecGroup > 0)
+                        lossEdge = (lossEdge - firstDataSeq + 1) / fecGroup * fecGroup +
+                                   firstDataSeq - 1;
+                    uint32_t sentMark = firstDataSeq + static_cast<uint32_t>(next) - 1;
+                    auto retransmitHole = [&](size_t idx) -> bool
+                    {
+                        SendSlot& hole = slotAt(idx);
+                        hole.lastSendTime  = now;
+                        hole.retransmitted = true;
+                        armTimer(idx, now);
+                        queueSlot(hole);
+                        if (txBatch.size() >= batchLimit && !flushTx())
+                            return false;
+                        ++totalPacketsSent;
+                        ++retransmissions;
+                        ++holeRetransmits;
+                        holeRetxQueue.push_back(
+                            HoleRetx{firstDataSeq + static_cast<uint32_t>(idx), sentMark, now});
+                        return true;
+                    };
+
+                    // 先复查已重传过的空洞：队首重传得最早，队首不满足条件时后面的也不满足。
+                    // 时间门限取 SRTT + RTTVAR，给确认的到达时间留一点抖动余量
+                    bool lossDetected = false;
+                    auto rearmAfter = std::chrono::microseconds(static_cast<int64_t>(
+                        rtt.srttUs > 0.0 ? rtt.srttUs + rtt.rttvarUs : RTO_MIN_MS * 1000.0));
+                    for (size_t pending = holeRetxQueue.size(); pending > 0; --pending)
+                    {
+                        HoleRetx entry = holeRetxQueue.front();
+                        size_t idx = static_cast<size_t>(entry.seq - firstDataSeq);
+                        // 已确认、已滑出窗口，或之后被超时重传接管的条目直接丢弃
+                        if (idx < base || slotAt(idx).acked ||
+                            slotAt(idx).lastSendTime != entry.sentAt)
+                        {
+                            holeRetxQueue.pop_front();
+                            continue;
+                        }
+                        bool newerReported = highSackSeq >= entry.sentMark + SACK_DUP_THRESH;
+                        if (!newerReported && now - entry.sentAt < rearmAfter)
+                            break;
+                        holeRetxQueue.pop_front();
+                        if (!retransmitHole(idx))
                         {
-                            size_t idx =
-                                static_cast<size_t>(seqNum - firstDataSeq);
-                            markIndexAcked(idx);
+                            closesocket(s);
+                            return;
                         }
+                        // 重传丢失仍属于同一轮恢复，不再单独减窗
+                        ++holeRearms;
+                    }
+
+                    uint32_t seq = std::max(holeScanSeq, cumAckedSeq) + 1;
+                    for (; seq <= lossEdge; ++seq)
+                    {
+                        size_t idx = static_cast<size_t>(seq - firstDataSeq);
+                        if (idx < base)
+                            continue;
+                        SendSlot& hole = slotAt(idx);
+                        if (hole.acked || !hole.sent)
+                            continue;
+
+                        if (!retransmitHole(idx))
+                        {
+                            closesocket(s);
+                            return;
+                        }
+                        lossDetected = true;
+                    }
+                    holeScanSeq = std::max(holeScanSeq, lossEdge);
+
+                    // 一轮恢复只减一次窗：恢复点是判定丢失时已发出的最高序号
+                    if (lossDetected && !inFastRecovery)
+                    {
+                        cc->onLoss(now);
+                        inFastRecovery = true;
+                        recoverSeq = firstDataSeq + static_cast<uint32_t>(next) - 1;
                     }
                 }
+
+                ++acksProcessed;
+                slotsExamined += examined;
+                maxSlotsPerAck = std::max(maxSlotsPerAck, examined);
+
+                if (ackRttUs > 0)
+                    rtt.onSample(static_cast<double>(ackRttUs));
                 //只有在本轮真的有新的分组被确认时，才进行窗口前移
                 if (anyNewAck)
                 {
                     // 窗口前移
                     //从当前base开始，只要连续的槽都被确认了，就把Base往右移
-                    while (base < slots.size() && slots[base].acked)
+                    while (base < loaded && slotAt(base).acked)
                         ++base;
+                    refill();   // 腾出的槽位立即装入后续文件内容
 
-                    // Reno 拥塞控制
-                    if (cwnd < ssthresh)
-                    {
-                        cwnd += 1.0;                 // 慢启动
-                    }
-                    else
-                    {
-                        cwnd += 1.0 / cwnd;          // 拥塞避免
-                    }
-                    if (cwnd > 64.0)
-                        cwnd = 64.0;
+                    cc->onAck(ackedNow, static_cast<double>(ackRttUs),
+                              next - base, now);
                 }
             }
         }
 
         // 检查超时重传
         auto now = Clock::now();
-        //只检查当前窗口中，已经发出去但还没有全部ACK的那一段的分组
-        for (size_t i = base; i < next; ++i)
+        bool newTimeoutEvent = false;   // 本轮是否出现了新的超时事件
+        //只弹出已经到期的定时器，不再遍历整个在途窗口
+        while (!timers.empty() && timers.top().deadline <= now)
         {
-            SendSlot& slot = slots[i];
-            if (!slot.sent || slot.acked)
+            RetxTimer t = timers.top();
+            timers.pop();
+            if (timerStale(t))
+            {
+                ++timersStale;
                 continue;
-            //计算距离上次发送过去经过的时间，即飞行的时长
-            auto elapsed = std::chrono::duration_cast<
-                std::chrono::milliseconds>(now - slot.lastSendTime).count();
+            }
 
-            if (elapsed > g_dataTimeoutMs)
+            SendSlot& slot = slotAt(t.idx);
+            //计算距离上次发送过去经过的时间，即飞行的时长
+            if (now - slot.lastSendTime < currentRto())
             {
-                /*std::cout << "[sender] timeout seq=" << slot.hdr.seq
-                        << " (elapsed=" << elapsed
-                        << "ms, RTO=" << g_dataTimeoutMs << "ms)\n";*/
+                // 设定定时器之后 RTO 被退避拉长了，按新的 RTO 重新挂上
+                armTimer(t.idx, slot.lastSendTime);
+                continue;
+            }
 
-                // 重传，先更新时间
-                slot.lastSendTime = now;
+            ++timersFired;
+            /*std::cout << "[sender] timeout seq=" << slot.hdr.seq
+                    << " (RTO=" << rtt.rtoUs << "us)\n";*/
 
-                if (!sendPacket(s, server,
-                                slot.hdr,
-                                slot.data.data(),
-                                static_cast<uint16_t>(slot.data.size())))
-                {
-                    closesocket(s);
-                    return;
-                }
+            // 在上次减窗之后才发出的分组超时，才算一次新的超时事件；
+            // 同一批在途分组接连超时只退避、减窗一次
+            if (slot.lastSendTime >= lastRtoCut)
+                newTimeoutEvent = true;
 
-                ++totalPacketsSent;
-                ++retransmissions;//总发送次数+1，重传次数+1
+            // 重传，先更新时间
+            slot.lastSendTime  = now;
+            slot.retransmitted = true;
+            armTimer(t.idx, now);
 
-                // 拥塞控制 —— 认为发生拥塞，退回慢启动
-                ssthresh = (cwnd / 2.0 < 2.0) ? 2.0 : (cwnd / 2.0);
-                cwnd     = ssthresh;
-                //窗口减半，退回到慢启动//拥塞避免交界点,减小发送速率，重新探测带宽
+            queueSlot(slot);
+            if (txBatch.size() >= batchLimit && !flushTx())
+            {
+                closesocket(s);
+                return;
             }
+
+            ++totalPacketsSent;
+            ++retransmissions;//总发送次数+1，重传次数+1
+        }
+        if (!flushTx())
+        {
+            closesocket(s);
+            return;
+        }
+
+        if (newTimeoutEvent)
+        {
+            ++rtoTimeouts;
+            lastRtoCut = now;
+            rtt.onTimeout();   // RTO 指数退避
+
+            // 拥塞控制 —— 认为发生拥塞，由算法决定如何减窗
+            cc->onTimeout(now);
         }
     }
 
     endTime = Clock::now();
-
-    // 主动发起四次挥手
-    senderFourWayClose(s, server);
+    // 挥手阶段回到 SO_RCVTIMEO 阻塞接收：先解除事件关联
+    const uint64_t loopWakeups      = waiter->wakeups();
+    const uint64_t loopTimerWakeups = waiter->timerWakeups();
+    const bool     loopHighRes      = waiter->highResolution();
+    waiter.reset();
+    setNonBlocking(s, false);
+
+    // 主动发起四次挥手，FIN 中带上文件摘要，接收端在它的 FIN 中回送自己算出的摘要
+    const uint64_t fileDigest = fileHash.digest();
+    uint64_t peerDigest    = 0;
+    bool     peerHasDigest = false;
+    const bool closed = senderFourWayClose(s, server, connId, integrityFlag, fileDigest,
+                                           peerDigest, peerHasDigest);
     closesocket(s);
 
+    // 只有接收端在挥手中确认了同样的摘要，这个连接才算成功
+    result.dataDone        = true;
+    result.closed          = closed;
+    result.digestMatch     = peerHasDigest && peerDigest == fileDigest;
+    result.ok              = closed && result.digestMatch;
+    result.bytesDelivered  = bytesDelivered;
+    result.packetsSent     = totalPacketsSent;
+    result.retransmissions = retransmissions;
+    result.startTime       = startTime;
+    result.endTime         = endTime;
+
     // 统计结果
     double durationSec =
         std::chrono::duration<double>(endTime - startTime).count();
@@ -551,14 +1473,249 @@ void runSender(const std::string& ip, uint16_t port, const std::string& inputFil
                   static_cast<double>(rttSamples)
             : 0.0;
 
-    std::cout << "===== RUDP Statistics (Sender) =====\n";
+    g_dataPath.txBatches += txBatches;
+    g_dataPath.txPackets += txBatchedPackets;
+    if (rio)
+    {
+        g_dataPath.rioSender = true;
+        g_dataPath.rioSends     += rio->sendsPosted();
+        g_dataPath.rioCommits   += rio->sendCommits();
+        g_dataPath.rioSendWaits += rio->sendWaits();
+    }
+
+    std::lock_guard<std::mutex> lock(g_statsMutex);
+    if (stream)
+        std::cout << "===== RUDP Statistics (Sender, stream " << stream->index + 1 << "/"
+                  << stream->count << ") =====\n";
+    else
+        std::cout << "===== RUDP Statistics (Sender) =====\n";
     std::cout << "Bytes delivered:       " << bytesDelivered << " bytes\n";
     std::cout << "Data packets sent:     " << totalPacketsSent
               << " (retransmissions=" << retransmissions << ")\n";
     std::cout << "Approx. loss rate:     " << lossRate * 100.0 << " %\n";
     std::cout << "Average RTT:           " << avgRttUs << " us\n";
+    std::cout << "SRTT / RTTVAR:         " << rtt.srttUs << " / "
+              << rtt.rttvarUs << " us (karn skipped=" << karnSkipped << ")\n";
+    std::cout << "RTO:                   " << rtt.rtoUs / 1000.0
+              << " ms (initial=" << g_dataTimeoutMs
+              << "ms, clamp=[" << RTO_MIN_MS << ", " << RTO_MAX_MS
+              << "]ms, timeouts=" << rtoTimeouts << ")\n";
+    std::cout << "I/O batches:           tx=" << txBatches << " (avg "
+              << (txBatches > 0 ? static_cast<double>(txBatchedPackets) /
+                                      static_cast<double>(txBatches)
+                                : 0.0)
+              << " pkts), rx=" << rxBatches << " (avg "
+              << (rxBatches > 0 ? static_cast<double>(rxBatchedPackets) /
+                                      static_cast<double>(rxBatches)
+                                : 0.0)
+              << " pkts), limit=" << batchLimit << "\n";
+    std::cout << "sendto calls:          " << sendCalls
+              << " (UDP offload " << (offloadSegment > 0 ? "on" : "off") << ")\n";
+    if (rio)
+        std::cout << "Registered I/O:        sends=" << rio->sendsPosted()
+                  << ", commits=" << rio->sendCommits() << " (avg "
+                  << (rio->sendCommits() > 0 ? static_cast<double>(rio->sendsPosted()) /
+                                                   static_cast<double>(rio->sendCommits())
+                                             : 0.0)
+                  << " pkts), slot waits=" << rio->sendWaits()
+                  << ", registered=" << (rio->registeredBytes() >> 10) << " KB\n";
+    else
+        std::cout << "Registered I/O:        off\n";
+    std::cout << "Retx timers:           fired=" << timersFired
+              << ", stale=" << timersStale << "\n";
+    std::cout << "Event loop:            wakeups=" << loopWakeups << " ("
+              << static_cast<double>(loopWakeups) / durationSec << "/s, deadline="
+              << loopTimerWakeups << ", ack=" << loopWakeups - loopTimerWakeups
+              << "), timer=" << (loopHighRes ? "high-resolution" : "default") << "\n";
+    std::cout << "Slots examined / ACK:  "
+              << (acksProcessed > 0
+                      ? static_cast<double>(slotsExamined) /
+                            static_cast<double>(acksProcessed)
+                      : 0.0)
+              << " (max=" << maxSlotsPerAck
+              << ", acks=" << acksProcessed << ")\n";
+    std::cout << "Data packets / ACK:    "
+              << (acksProcessed > 0
+                      ? static_cast<double>(totalPacketsSent) /
+                            static_cast<double>(acksProcessed)
+                      : 0.0)
+              << "\n";
     std::cout << "Throughput:            " << throughputMBps
               << " MB/s (" << throughputMbps << " Mbps)\n";
 
+    if (g_pacingEnabled)
+    {
+        std::cout << "Pacing:                avg rate="
+                  << (pacingRateSamples > 0
+                          ? pacingRateSum / static_cast<double>(pacingRateSamples)
+                          : 0.0)
+                  << " pkt/s, held=" << pacingHolds
+                  << ", total delay=" << pacingDelayUs / 1000.0 << " ms\n";
+    }
+    else
+    {
+        std::cout << "Pacing:                disabled\n";
+    }
+    std::cout << "Congestion control:    " << cc->name()
+              << " (final cwnd=" << cc->cwnd()
+              << ", ssthresh=" << cc->ssthresh() << ")\n";
     std::cout << "Configured recv window: " << g_recvWindow << " packets\n";
+    std::cout << "Send ring capacity:    " << ringCap << " slots\n";
+    std::cout << "Payload size:          " << payloadSize << " bytes (requested="
+              << (g_payloadSize > 0 ? g_payloadSize : MAX_PAYLOAD)
+              << ", negotiated=" << negotiatedPayload
+              << ", probes=" << probesSent
+              << ", socket send buffer=" << (socketSendBuffer >> 10) << " KB)\n";
+    if (g_mmapInput)
+        std::cout << "Input:                 memory-mapped ("
+                  << (mapped.size() >> 20) << " MB, prefetch calls="
+                  << mapped.prefetchCalls() << ")\n";
+    else
+        std::cout << "Input:                 stream read into ring slots\n";
+    if (integrityFlag)
+        std::cout << "Integrity:             crc32c (" << crc32cKernelName() << ")\n";
+    else
+        std::cout << "Integrity:             checksum16 (" << checksumKernelName() << ")\n";
+    if (fecGroup > 0)
+        std::cout << "FEC:                   xor, group=" << fecGroup
+                  << ", parity sent=" << paritySent << " ("
+                  << (totalPacketsSent > 0 ? 100.0 * static_cast<double>(paritySent) /
+                                                 static_cast<double>(totalPacketsSent)
+                                           : 0.0)
+                  << " % overhead), retransmissions=" << retransmissions
+                  << " at emulated loss " << g_lossRate * 100.0 << " %\n";
+    if (bitmapSack)
+        std::cout << "SACK format:           bitmap (hole retransmits=" << holeRetransmits
+                  << ", re-armed=" << holeRearms
+                  << ", highest SACKed seq=" << highSackSeq << ")\n";
+    else
+        std::cout << "SACK format:           blocks (up to " << MAX_SACK_BLOCKS
+                  << " ranges per ACK)\n";
+
+    double hashSec = static_cast<double>(hashNs) / 1e9;
+    std::cout << "File digest:           xxh64=" << digestHex(fileDigest)
+              << " (" << fileHash.totalBytes() << " bytes hashed at "
+              << (hashSec > 0.0 ? static_cast<double>(fileHash.totalBytes()) /
+                                      hashSec / (1024.0 * 1024.0)
+                                : 0.0)
+              << " MB/s)\n";
+    if (!peerHasDigest)
+        std::cout << "Receiver digest:       not reported\n";
+    else if (peerDigest == fileDigest)
+        std::cout << "Receiver digest:       match\n";
+    else
+        std::cout << "Receiver digest:       MISMATCH (xxh64="
+                  << digestHex(peerDigest) << ")\n";
+}
+
+// 输入文件长度，打不开时返回 false
+static bool inputFileSize(const std::string& path, uint64_t& size)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+        return false;
+    size = static_cast<uint64_t>(in.tellg());
+    return true;
+}
+
+bool runSender(const std::string& ip, uint16_t port, const std::string& inputFile)
+{
+    // --streams=K：文件切成 K 段连续的字节范围，每段一个独立连接（各自的套接字、
+    // 发送环和拥塞控制），各由一个线程驱动；接收端按传输号把各段拼进同一个文件
+    uint64_t fileSize = 0;
+    if (g_streams <= 1 || !inputFileSize(inputFile, fileSize) || fileSize < 2)
+    {
+        StreamResult result;
+        sendStream(ip, port, inputFile, nullptr, result);
+        if (!result.ok)
+            std::cerr << "[sender] transfer FAILED\n";
+        return result.ok;
+    }
+
+    const uint16_t count = static_cast<uint16_t>(
+        std::min<uint64_t>(static_cast<uint64_t>(g_streams), fileSize));
+    const uint32_t transferId = newConnectionId();
+    std::vector<StreamDescriptor> streams(count);
+    std::vector<StreamResult>     results(count);
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        StreamDescriptor& d = streams[i];
+        d.transferId = transferId;
+        d.index      = i;
+        d.count      = count;
+        d.offset     = fileSize * i / count;
+        d.length     = fileSize * (i + 1) / count - d.offset;
+        d.fileSize   = fileSize;
+    }
+    std::cout << "[sender] " << count << " parallel streams, transfer id " << std::hex
+              << transferId << std::dec << ", " << fileSize << " bytes\n";
+
+    std::vector<std::thread> threads;
+    for (uint16_t i = 0; i < count; ++i)
+        threads.emplace_back([&, i]()
+                             { sendStream(ip, port, inputFile, &streams[i], results[i]); });
+    for (std::thread& t : threads)
+        t.join();
+
+    // 汇总：总时长取最早开始到最晚结束，吞吐按整个文件计算
+    uint64_t bytesDelivered = 0, packetsSent = 0, retransmissions = 0;
+    uint16_t streamsOk = 0, streamsDone = 0, digestsMatched = 0;
+    Clock::time_point startTime = Clock::time_point::max();
+    Clock::time_point endTime   = Clock::time_point::min();
+    for (const StreamResult& r : results)
+    {
+        if (r.ok)
+            ++streamsOk;
+        if (r.digestMatch)
+            ++digestsMatched;
+        // 吞吐按数据全部确认的流计算，挥手或摘要失败的流仍然计入，但整个传输判为失败
+        if (!r.dataDone)
+            continue;
+        ++streamsDone;
+        bytesDelivered  += r.bytesDelivered;
+        packetsSent     += r.packetsSent;
+        retransmissions += r.retransmissions;
+        startTime = std::min(startTime, r.startTime);
+        endTime   = std::max(endTime, r.endTime);
+    }
+    double durationSec = streamsDone > 0
+                             ? std::chrono::duration<double>(endTime - startTime).count()
+                             : 0.0;
+    if (durationSec <= 0.0)
+        durationSec = 1e-6;
+    double throughputMBps =
+        static_cast<double>(bytesDelivered) / durationSec / (1024.0 * 1024.0);
+
+    std::cout << "===== RUDP Statistics (Sender, " << count << " streams) =====\n";
+    std::cout << "Bytes delivered:       " << bytesDelivered << " / " << fileSize
+              << " bytes\n";
+    std::cout << "Streams:               " << streamsOk << " succeeded of " << count
+              << " (data acknowledged=" << streamsDone << ", digests matched="
+              << digestsMatched << ")\n";
+    std::cout << "Data packets sent:     " << packetsSent
+              << " (retransmissions=" << retransmissions << ")\n";
+    std::cout << "Duration:              " << durationSec << " s\n";
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        const StreamResult& r = results[i];
+        double sec = std::chrono::duration<double>(r.endTime - r.startTime).count();
+        std::cout << "Stream " << i + 1 << ":              "
+                  << (r.ok          ? ""
+                      : !r.dataDone ? "FAILED, "
+                      : !r.closed   ? "FAILED (close), "
+                                    : "FAILED (digest), ")
+                  << r.bytesDelivered << " bytes, "
+                  << (r.dataDone && sec > 0.0 ? static_cast<double>(r.bytesDelivered) / sec /
+                                              (1024.0 * 1024.0)
+                                        : 0.0)
+                  << " MB/s (retransmissions=" << r.retransmissions << ")\n";
+    }
+    std::cout << "Throughput:            " << throughputMBps << " MB/s ("
+              << throughputMBps * 8.0 << " Mbps, aggregate)\n";
+
+    // 任何一个流没有被接收端确认，文件就不完整
+    if (streamsOk != count)
+        std::cerr << "[sender] transfer FAILED: " << count - streamsOk << " of " << count
+                  << " streams not confirmed by the receiver\n";
+    return streamsOk == count;
 }
@@ -0,0 +1,211 @@
+// rudp_writer.cpp —— 接收端异步写盘线程
+#include "rudp_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+DiskWriter::DiskWriter(std::ofstream& out, size_t packetBytes)
+    : out_(out),
+      packetBytes_(packetBytes),
+      chunkBytes_(WRITE_CHUNK_BYTES),
+      data_(WRITE_QUEUE_CHUNKS * chunkBytes_),
+      lens_(WRITE_QUEUE_CHUNKS, 0)
+{
+    thread_ = std::thread(&DiskWriter::writerLoop, this);
+}
+
+
+DiskWriter::~DiskWriter()
+{
+    finish();
+}
+
+
+void DiskWriter::append(const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        // 当前块所在的槽位还没被写线程腾出来：队列满，睡到写线程写完一块。
+        // 正常情况下通告窗口会先让发送端停下来，走到这里说明磁盘明显跟不上
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= WRITE_QUEUE_CHUNKS)
+        {
+            ++stalls_;
+            idleCv_.notify_one();
+            // waiting_ 与 head_ 都用顺序一致的读写：要么这里看到写线程推进后的 head_，
+            // 要么写线程看到 waiting_ 并在锁内唤醒，不会漏掉唤醒
+            std::unique_lock<std::mutex> lock(spaceMutex_);
+            waiting_.store(true);
+            spaceCv_.wait(lock, [&]() { return tail - head_.load() < WRITE_QUEUE_CHUNKS; });
+            waiting_.store(false);
+        }
+
+        size_t n = std::min(len, chunkBytes_ - fill_);
+        std::memcpy(&data_[(tail % WRITE_QUEUE_CHUNKS) * chunkBytes_ + fill_], data, n);
+        fill_ += n;
+        data  += n;
+        len   -= n;
+
+        if (fill_ == chunkBytes_)
+            publish();
+    }
+}
+
+
+size_t DiskWriter::freePackets() const
+{
+    size_t queued = tail_.load(std::memory_order_relaxed) -
+                    head_.load(std::memory_order_acquire);
+    // 正在填充的块也算在空闲块里，扣掉它已经用掉的部分
+    size_t freeBytes = (WRITE_QUEUE_CHUNKS - queued) * chunkBytes_ - fill_;
+    return freeBytes / packetBytes_;
+}
+
+
+// 把当前块交给写线程（release 保证写线程看到块内容和长度）
+void DiskWriter::publish()
+{
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    lens_[tail % WRITE_QUEUE_CHUNKS] = fill_;
+    tail_.store(tail + 1, std::memory_order_release);
+    fill_ = 0;
+
+    maxQueued_ = std::max(maxQueued_,
+                          tail + 1 - head_.load(std::memory_order_relaxed));
+    idleCv_.notify_one();
+}
+
+
+bool DiskWriter::finish()
+{
+    if (!finished_)
+    {
+        finished_ = true;
+        if (fill_ > 0)
+            publish();
+        done_.store(true, std::memory_order_release);
+        idleCv_.notify_one();
+        thread_.join();
+        out_.flush();
+    }
+    return !failed_.load() && out_.good();
+}
+
+
+void DiskWriter::writerLoop()
+{
+    while (true)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            // done_ 在最后一个块发布之后才置位，看到它时再读一次 tail 就不会漏块
+            if (done_.load(std::memory_order_acquire) &&
+                head == tail_.load(std::memory_order_acquire))
+                break;
+
+            // 队列空：睡到网络线程发布新块（通知没有加锁可能错过，超时兜底）
+            std::unique_lock<std::mutex> lock(idleMutex_);
+            idleCv_.wait_for(lock, std::chrono::milliseconds(5));
+            continue;
+        }
+
+        size_t slot = head % WRITE_QUEUE_CHUNKS;
+        if (!failed_.load(std::memory_order_relaxed))
+        {
+            out_.write(&data_[slot * chunkBytes_],
+                       static_cast<std::streamsize>(lens_[slot]));
+            if (!out_)
+                failed_.store(true);
+        }
+        head_.store(head + 1);
+        chunksWritten_.fetch_add(1, std::memory_order_relaxed);
+        if (waiting_.load())
+        {
+            std::lock_guard<std::mutex> lock(spaceMutex_);
+            spaceCv_.notify_one();
+        }
+    }
+}
+
+
+// ======================= 定位写 =======================
+
+PositionalFile::~PositionalFile()
+{
+    close();
+}
+
+
+bool PositionalFile::open(const std::string& path)
+{
+    file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+        return false;
+    allocated_ = 0;
+    writes_    = 0;
+    return true;
+}
+
+
+bool PositionalFile::preallocate(uint64_t size)
+{
+    FILE_ALLOCATION_INFO alloc{};
+    alloc.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    FILE_END_OF_FILE_INFO eof{};
+    eof.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    // 分配失败只影响性能；文件长度必须设好，各流结束的先后不影响最终长度
+    SetFileInformationByHandle(file_, FileAllocationInfo, &alloc, sizeof(alloc));
+    if (!SetFileInformationByHandle(file_, FileEndOfFileInfo, &eof, sizeof(eof)))
+        return false;
+    allocated_ = size;
+    return true;
+}
+
+
+bool PositionalFile::writeAt(uint64_t offset, const char* data, size_t len)
+{
+    uint64_t end = offset + len;
+    if (end > allocated_)
+    {
+        // 提前成段分配磁盘空间，减少乱序写把文件切成碎片；失败只影响性能
+        FILE_ALLOCATION_INFO info{};
+        uint64_t want = (end + PREALLOC_STEP - 1) / PREALLOC_STEP * PREALLOC_STEP;
+        info.AllocationSize.QuadPart = static_cast<LONGLONG>(want);
+        SetFileInformationByHandle(file_, FileAllocationInfo, &info, sizeof(info));
+        allocated_ = want;
+    }
+
+    // 同步句柄上带偏移的 WriteFile 就是 pwrite：不移动也不依赖文件指针
+    OVERLAPPED ov{};
+    ov.Offset     = static_cast<DWORD>(offset & 0xFFFFFFFFu);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written = 0;
+    if (!WriteFile(file_, data, static_cast<DWORD>(len), &written, &ov) ||
+        written != len)
+        return false;
+    writes_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+
+bool PositionalFile::readAt(uint64_t offset, char* data, size_t len)
+{
+    OVERLAPPED ov{};
+    ov.Offset     = static_cast<DWORD>(offset & 0xFFFFFFFFu);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD got = 0;
+    return ReadFile(file_, data, static_cast<DWORD>(len), &got, &ov) && got == len;
+}
+
+
+void PositionalFile::close()
+{
+    if (file_ != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+}
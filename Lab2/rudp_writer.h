@@ -0,0 +1,105 @@
+// rudp_writer.h —— 接收端异步写盘：网络线程只把按序数据放进队列，由写线程落盘
+#pragma once
+#include "rudp.h"
+#include <windows.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline constexpr size_t WRITE_CHUNK_BYTES   = 256u << 10;   // 每个队列块 256KB（与协商负载无关，分组可以跨块）
+inline constexpr size_t WRITE_QUEUE_CHUNKS  = 16;   // 队列块数
+inline constexpr size_t WRITE_QUEUE_BYTES   = WRITE_CHUNK_BYTES * WRITE_QUEUE_CHUNKS;   // 每个会话 4MB
+inline constexpr uint64_t PREALLOC_STEP     = 64ull << 20;   // 定位写模式每次预分配 64MB
+
+// 单生产者（网络线程）/ 单消费者（写线程）的定长块队列：
+// 块的发布 / 回收只靠 head_ / tail_ 两个原子下标，不加锁；
+// 互斥量和条件变量只用来让空闲的写线程 / 队列满时的网络线程睡眠，不在数据路径上
+class DiskWriter
+{
+public:
+    // packetBytes：协商后的满长分组负载，只用于 freePackets 的换算
+    DiskWriter(std::ofstream& out, size_t packetBytes);
+    ~DiskWriter();
+    DiskWriter(const DiskWriter&) = delete;
+    DiskWriter& operator=(const DiskWriter&) = delete;
+
+    // 网络线程：追加一段按序数据（拷进当前块，块满即发布）；
+    // 队列满时等待写线程腾出块，正常情况下通告窗口会让发送端先停下来
+    void append(const char* data, size_t len);
+
+    // 网络线程：队列还能再接收多少个满长分组，用于计算通告窗口
+    size_t freePackets() const;
+
+    // 发布最后一个未满的块，等写线程把队列写完并退出；返回写盘是否全部成功
+    bool finish();
+
+    uint64_t chunksWritten() const { return chunksWritten_.load(); }
+    uint64_t stalls() const { return stalls_; }
+    size_t   maxQueued() const { return maxQueued_; }
+
+private:
+    void publish();
+    void writerLoop();
+
+    std::ofstream&      out_;
+    const size_t        packetBytes_;
+    const size_t        chunkBytes_;
+    std::vector<char>   data_;   // WRITE_QUEUE_CHUNKS 个块首尾相接
+    std::vector<size_t> lens_;   // 每个已发布块的有效字节数
+
+    std::atomic<size_t> head_{0};   // 写线程下一个要写的块（单调递增）
+    std::atomic<size_t> tail_{0};   // 网络线程正在填充的块（单调递增）
+    size_t              fill_ = 0;  // 当前块已填充的字节数（只有网络线程访问）
+
+    std::atomic<bool> done_{false};
+    std::atomic<bool> failed_{false};
+    bool              finished_ = false;
+
+    std::mutex              idleMutex_;
+    std::condition_variable idleCv_;
+    // 队列满时网络线程睡在这里，写线程每写完一块检查 waiting_ 决定是否唤醒
+    std::mutex              spaceMutex_;
+    std::condition_variable spaceCv_;
+    std::atomic<bool>       waiting_{false};
+    std::thread             thread_;
+
+    std::atomic<uint64_t> chunksWritten_{0};
+    uint64_t stalls_    = 0;   // 网络线程因队列满而等待的次数
+    size_t   maxQueued_ = 0;   // 队列中最多同时排队的块数
+};
+
+// 定位写：每个分组按 (seq-1) * 协商负载 直接写到文件中的固定偏移，
+// 乱序分组不必留在内存里等前面的空洞补齐。
+// 不知道文件总长，写到已分配范围之外时按 PREALLOC_STEP 扩大磁盘空间分配（不改变文件长度），
+// 文件长度由写到最远处的那次写操作决定，关闭时多余的分配自动释放
+class PositionalFile
+{
+public:
+    PositionalFile() = default;
+    ~PositionalFile();
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+
+    bool open(const std::string& path);
+    // 文件长度已知时（多流传输）一次分配好全部空间并设好文件长度，之后的写入不再扩展
+    bool preallocate(uint64_t size);
+    bool writeAt(uint64_t offset, const char* data, size_t len);
+    // 读回已经写入的一段（乱序写入的分组按序计算摘要时用，刚写过的数据还在页缓存里）
+    bool readAt(uint64_t offset, char* data, size_t len);
+    void close();
+
+    uint64_t writes() const { return writes_.load(std::memory_order_relaxed); }
+    uint64_t preallocated() const { return allocated_; }
+
+private:
+    HANDLE   file_      = INVALID_HANDLE_VALUE;
+    uint64_t allocated_ = 0;
+    // 多流传输时几个工作线程上的流可能同时写同一个文件
+    std::atomic<uint64_t> writes_{0};
+};